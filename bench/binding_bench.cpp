@@ -0,0 +1,253 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#include <mrbind14/mrbind14.hpp>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Functions are called from C++ with mrb_funcall_argv on the top-level
+// object, which goes through function_overload_resolver exactly as a
+// call from a script would, without the cost of parsing.
+
+// Makes one call, restoring the GC arena after it. Returns false, and
+// marks the benchmark as failed, if the call raised: a binding raising
+// an exception would otherwise be timed as a fast success.
+static bool funcall(benchmark::State& state, mrb_state* mrb, mrb_value self, mrb_sym sym,
+                    mrb_int nargs, const mrb_value* args) {
+    int ai = mrb_gc_arena_save(mrb);
+    benchmark::DoNotOptimize(mrb_funcall_argv(mrb, self, sym, nargs, args));
+    mrb_gc_arena_restore(mrb, ai);
+    if(!mrb->exc) return true;
+    mrb->exc = nullptr;
+    state.SkipWithError("the benchmarked call raised an exception");
+    return false;
+}
+
+static void f0() {}
+
+static int f1(int a) {
+    return a;
+}
+
+static int f4(int a, int b, int c, int d) {
+    return a + b + c + d;
+}
+
+static int f8(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return a + b + c + d + e + f + g + h;
+}
+
+static size_t string_in(const std::string& s) {
+    return s.size();
+}
+
+static void call_function(benchmark::State& state, const char* name, unsigned nargs) {
+    mrbind14::interpreter mruby;
+    mruby.def_function("f0", f0);
+    mruby.def_function("f1", f1);
+    mruby.def_function("f4", f4);
+    mruby.def_function("f8", f8);
+    auto mrb  = mruby.mrb();
+    auto self = mrb_top_self(mrb);
+    auto sym  = mrb_intern_cstr(mrb, name);
+    mrb_value args[8];
+    for(unsigned i = 0; i < 8; i++) args[i] = mrb_fixnum_value(i);
+    for(auto _ : state) {
+        if(!funcall(state, mrb, self, sym, nargs, args)) break;
+    }
+}
+
+static void BM_call_empty(benchmark::State& state) {
+    call_function(state, "f0", 0);
+}
+BENCHMARK(BM_call_empty);
+
+static void BM_call_1_arg(benchmark::State& state) {
+    call_function(state, "f1", 1);
+}
+BENCHMARK(BM_call_1_arg);
+
+static void BM_call_4_args(benchmark::State& state) {
+    call_function(state, "f4", 4);
+}
+BENCHMARK(BM_call_4_args);
+
+static void BM_call_8_args(benchmark::State& state) {
+    call_function(state, "f8", 8);
+}
+BENCHMARK(BM_call_8_args);
+
+static void BM_string_in(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    mruby.def_function("string_in", string_in);
+    auto mrb  = mruby.mrb();
+    auto self = mrb_top_self(mrb);
+    auto sym  = mrb_intern_cstr(mrb, "string_in");
+    auto arg  = mrb_str_new(mrb, std::string(state.range(0), 'x').data(), state.range(0));
+    mrb_gc_register(mrb, arg);
+    for(auto _ : state) {
+        if(!funcall(state, mrb, self, sym, 1, &arg)) break;
+    }
+    mrb_gc_unregister(mrb, arg);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_string_in)->Arg(8)->Arg(256)->Arg(4096);
+
+static void BM_string_out(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    std::string str(state.range(0), 'x');
+    mruby.def_function("string_out", [&str]() { return str; });
+    auto mrb  = mruby.mrb();
+    auto self = mrb_top_self(mrb);
+    auto sym  = mrb_intern_cstr(mrb, "string_out");
+    for(auto _ : state) {
+        if(!funcall(state, mrb, self, sym, 0, nullptr)) break;
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_string_out)->Arg(8)->Arg(256)->Arg(4096);
+
+// Hashes a string the slow way, standing in for an expensive pure function
+static uint64_t slow_hash(const std::string& s) {
+    uint64_t h = 14695981039346656037ull;
+    for(int round = 0; round < 64; round++)
+        for(char c : s) h = (h ^ (unsigned char)c) * 1099511628211ull;
+    return h & 0xffffffff;
+}
+
+// Argument 0 binds slow_hash as is, 1 binds it with memoize()
+static void BM_call_memoized(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    if(state.range(0)) mruby.def_function("slow_hash", slow_hash, mrbind14::memoize());
+    else mruby.def_function("slow_hash", slow_hash);
+    auto mrb  = mruby.mrb();
+    auto self = mrb_top_self(mrb);
+    auto sym  = mrb_intern_cstr(mrb, "slow_hash");
+    auto arg  = mrb_str_new_cstr(mrb, "Lyon, France");
+    mrb_gc_register(mrb, arg);
+    for(auto _ : state) {
+        if(!funcall(state, mrb, self, sym, 1, &arg)) break;
+    }
+    mrb_gc_unregister(mrb, arg);
+}
+BENCHMARK(BM_call_memoized)->Arg(0)->Arg(1);
+
+static double score(double x, double y) {
+    return x * 0.75 + y * 0.25;
+}
+
+// Evaluates score over two Arrays of state.range(0) floats, from a Ruby
+// loop calling the scalar form, then with a single vectorized call
+static void vectorized_score(benchmark::State& state, const char* script) {
+    mrbind14::interpreter mruby;
+    mruby.def_vectorized("score", score);
+    auto n = state.range(0);
+    mruby.set_global("$n", (int)n);
+    mruby.execute("$xs = Array.new($n) { |i| i.to_f }; $ys = $xs.reverse");
+    for(auto _ : state) {
+        int ai = mrb_gc_arena_save(mruby.mrb());
+        benchmark::DoNotOptimize(mruby.execute(script));
+        mrb_gc_arena_restore(mruby.mrb(), ai);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_score_ruby_loop(benchmark::State& state) {
+    vectorized_score(state, "$xs.each_with_index.map { |x, i| score(x, $ys[i]) }.size");
+}
+BENCHMARK(BM_score_ruby_loop)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_score_vectorized(benchmark::State& state) {
+    vectorized_score(state, "score($xs, $ys).size");
+}
+BENCHMARK(BM_score_vectorized)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_execute_small_script(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    const char* script = "a = [1, 2, 3]; a.map { |x| x * 2 }.size";
+    for(auto _ : state) {
+        int ai = mrb_gc_arena_save(mruby.mrb());
+        benchmark::DoNotOptimize(mruby.execute(script));
+        mrb_gc_arena_restore(mruby.mrb(), ai);
+    }
+}
+BENCHMARK(BM_execute_small_script);
+
+// Iterating over C++ values from Ruby, either by yielding each value
+// to a block or by returning a range over them.
+
+static void BM_yield_block(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    mruby.def_function("each_value", [](int n, mrbind14::block b) {
+        auto yield = b.invoker<int>();
+        for(int i = 0; i < n; i++) yield(i);
+    });
+    mruby.set_global("$n", static_cast<int>(state.range(0)));
+    for(auto _ : state) {
+        int ai = mrb_gc_arena_save(mruby.mrb());
+        benchmark::DoNotOptimize(mruby.execute("s = 0; each_value($n) { |x| s += x }; s"));
+        mrb_gc_arena_restore(mruby.mrb(), ai);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_yield_block)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_range_each(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    mruby.def_function("values", [](int n) {
+        std::vector<int> v(n);
+        for(int i = 0; i < n; i++) v[i] = i;
+        return mrbind14::make_range(std::move(v));
+    });
+    mruby.set_global("$n", static_cast<int>(state.range(0)));
+    for(auto _ : state) {
+        int ai = mrb_gc_arena_save(mruby.mrb());
+        benchmark::DoNotOptimize(mruby.execute("s = 0; values($n).each { |x| s += x }; s"));
+        mrb_gc_arena_restore(mruby.mrb(), ai);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_range_each)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_set_global(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    int i = 0;
+    for(auto _ : state) {
+        mruby.set_global("$value", i++);
+    }
+}
+BENCHMARK(BM_set_global);
+
+static void BM_get_global(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    mruby.set_global("$value", 42);
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(mruby.get_global<int>("$value"));
+    }
+}
+BENCHMARK(BM_get_global);
+
+static void BM_get_cpp_class_name(benchmark::State& state) {
+    mrbind14::interpreter mruby;
+    auto mrb = mruby.mrb();
+    for(auto _ : state) {
+        int ai = mrb_gc_arena_save(mrb);
+        benchmark::DoNotOptimize(mrbind14::detail::get_cpp_class_name<double>(mrb));
+        mrb_gc_arena_restore(mrb, ai);
+    }
+}
+BENCHMARK(BM_get_cpp_class_name);
+
+static void BM_interpreter_construction(benchmark::State& state) {
+    for(auto _ : state) {
+        mrbind14::interpreter mruby;
+        benchmark::DoNotOptimize(mruby.mrb());
+    }
+}
+BENCHMARK(BM_interpreter_construction);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,37 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#include <mrbind14/mrbind14.hpp>
+#include <string>
+#include <utility>
+
+// Binding translation unit used by compile_cost.sh to measure the cost
+// of compiling bound functions: it binds MRBIND14_BENCH_FUNCTIONS
+// lambdas, each of which is a distinct type and instantiates its own
+// binding code, as in a real binding layer.
+
+#ifndef MRBIND14_BENCH_FUNCTIONS
+#define MRBIND14_BENCH_FUNCTIONS 100
+#endif
+
+template<size_t I>
+static void bind_one(mrbind14::module& mod) {
+    std::string name = "f" + std::to_string(I);
+    mod.def_function(name.c_str(), [](int a, double b, const std::string& s) {
+        return a + b * I + s.size();
+    });
+}
+
+template<size_t ... I>
+static void bind_all(mrbind14::module& mod, std::index_sequence<I...>) {
+    int dummy[] = { 0, (bind_one<I>(mod), 0)... };
+    (void)dummy;
+}
+
+int main() {
+    mrbind14::interpreter mruby;
+    bind_all(mruby, std::make_index_sequence<MRBIND14_BENCH_FUNCTIONS>());
+    return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Measures the compile time of a binding translation unit (compile_cost.cpp)
+# and reports the cost per bound function, in header-only mode and with
+# the compiled library (MRBIND14_COMPILED_LIBRARY).
+#
+# Usage: compile_cost.sh <compiler> <source> <functions> [compiler flags...]
+
+CXX=$1
+SOURCE=$2
+FUNCTIONS=$3
+shift 3
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# Prints the time in milliseconds taken to compile the source with the given flags
+compile_ms() {
+    start=$(now_ms)
+    "$CXX" "$@" -c "$SOURCE" -o /dev/null || exit 1
+    end=$(now_ms)
+    echo $(( end - start ))
+}
+
+for mode in header-only compiled; do
+    if [ "$mode" = compiled ]; then
+        flags="-DMRBIND14_COMPILED_LIBRARY"
+    else
+        flags=""
+    fi
+    base=$(compile_ms "$@" $flags -DMRBIND14_BENCH_FUNCTIONS=0)
+    full=$(compile_ms "$@" $flags -DMRBIND14_BENCH_FUNCTIONS=$FUNCTIONS)
+    per_function=$(awk "BEGIN { printf \"%.2f\", ($full - $base) / $FUNCTIONS }")
+    echo "$mode: base ${base} ms, ${FUNCTIONS} functions ${full} ms, ${per_function} ms per function"
+done
@@ -0,0 +1,222 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#include <mrbind14/mrbind14.hpp>
+#include <benchmark/benchmark.h>
+#include <string>
+
+// Compares the native JSON module with a JSON implementation written
+// in Ruby (using only mruby's core classes, so byte by byte), on
+// documents of a few megabytes generated from the benchmark's range.
+
+static const char* pure_ruby_json = R"ruby(
+class PureJSON
+  def self.parse(s)
+    new(s).parse
+  end
+
+  def self.generate(v)
+    case v
+    when Hash   then "{" + v.map { |k, x| generate(k.to_s) + ":" + generate(x) }.join(",") + "}"
+    when Array  then "[" + v.map { |x| generate(x) }.join(",") + "]"
+    when String then '"' + escape(v) + '"'
+    when nil    then "null"
+    else v.to_s
+    end
+  end
+
+  def self.escape(s)
+    return s unless s.include?('"') || s.include?("\\") || s.include?("\n")
+    out = ""
+    s.each_char do |c|
+      out << (c == '"' ? '\\"' : c == "\\" ? "\\\\" : c == "\n" ? "\\n" : c)
+    end
+    out
+  end
+
+  def initialize(s)
+    @s = s
+    @i = 0
+  end
+
+  def parse
+    v = value
+    ws
+    v
+  end
+
+  def ws
+    c = @s.getbyte(@i)
+    while c == 32 || c == 10 || c == 13 || c == 9
+      @i += 1
+      c = @s.getbyte(@i)
+    end
+  end
+
+  def value
+    ws
+    c = @s.getbyte(@i)
+    if c == 123 then object
+    elsif c == 91 then array
+    elsif c == 34 then string
+    elsif c == 116 then @i += 4; true
+    elsif c == 102 then @i += 5; false
+    elsif c == 110 then @i += 4; nil
+    else number
+    end
+  end
+
+  def object
+    h = {}
+    @i += 1
+    ws
+    if @s.getbyte(@i) == 125
+      @i += 1
+      return h
+    end
+    while true
+      ws
+      k = string
+      ws
+      @i += 1
+      h[k] = value
+      ws
+      c = @s.getbyte(@i)
+      @i += 1
+      return h if c == 125
+    end
+  end
+
+  def array
+    a = []
+    @i += 1
+    ws
+    if @s.getbyte(@i) == 93
+      @i += 1
+      return a
+    end
+    while true
+      a << value
+      ws
+      c = @s.getbyte(@i)
+      @i += 1
+      return a if c == 93
+    end
+  end
+
+  def string
+    @i += 1
+    start = @i
+    out = nil
+    while true
+      c = @s.getbyte(@i)
+      if c == 34
+        part = @s.byteslice(start, @i - start)
+        @i += 1
+        return out ? out << part : part
+      elsif c == 92
+        out ||= ""
+        out << @s.byteslice(start, @i - start)
+        e = @s.getbyte(@i + 1)
+        out << (e == 110 ? "\n" : e == 116 ? "\t" : e == 114 ? "\r" : e.chr)
+        @i += 2
+        start = @i
+      else
+        @i += 1
+      end
+    end
+  end
+
+  def number
+    start = @i
+    float = false
+    while (c = @s.getbyte(@i)) && ((c >= 48 && c <= 57) || c == 45 || c == 43 || c == 46 || c == 101 || c == 69)
+      float = true if c == 46 || c == 101 || c == 69
+      @i += 1
+    end
+    t = @s.byteslice(start, @i - start)
+    float ? t.to_f : t.to_i
+  end
+end
+
+def make_document(n)
+  (0...n).map do |i|
+    { "id" => i, "name" => "item number #{i}", "active" => i.even?, "score" => i * 0.25,
+      "tags" => ["alpha", "beta", "gamma"], "note" => "line one\nline \"two\"",
+      "position" => { "x" => i, "y" => -i, "z" => nil } }
+  end
+end
+)ruby";
+
+struct json_fixture {
+    mrbind14::interpreter mruby;
+    mrb_value             document;
+    mrb_value             text;
+
+    json_fixture(int64_t records) {
+        mruby.def_json_module();
+        mruby.execute(pure_ruby_json);
+        mruby.set_global("$records", static_cast<int>(records));
+        document = mruby.execute("make_document($records)").value();
+        mrb_gc_register(mruby.mrb(), document);
+        text = mruby.execute("JSON.generate(make_document($records))").value();
+        mrb_gc_register(mruby.mrb(), text);
+    }
+
+    ~json_fixture() {
+        mrb_gc_unregister(mruby.mrb(), document);
+        mrb_gc_unregister(mruby.mrb(), text);
+    }
+
+    size_t text_size() const {
+        return RSTRING_LEN(text);
+    }
+
+    void run(benchmark::State& state, const char* receiver, const char* function, mrb_value arg) {
+        auto mrb  = mruby.mrb();
+        auto recv = mrb_const_get(mrb, mrb_obj_value(mrb->object_class), mrb_intern_cstr(mrb, receiver));
+        auto sym  = mrb_intern_cstr(mrb, function);
+        for(auto _ : state) {
+            int ai = mrb_gc_arena_save(mrb);
+            benchmark::DoNotOptimize(mrb_funcall_argv(mrb, recv, sym, 1, &arg));
+            mrb_gc_arena_restore(mrb, ai);
+            if(mrb->exc) {
+                mrb->exc = nullptr;
+                state.SkipWithError("the benchmarked call raised an exception");
+                break;
+            }
+            state.PauseTiming();
+            mrb_full_gc(mrb);
+            state.ResumeTiming();
+        }
+        state.SetBytesProcessed(state.iterations() * text_size());
+    }
+};
+
+static void BM_json_parse_native(benchmark::State& state) {
+    json_fixture fixture(state.range(0));
+    fixture.run(state, "JSON", "parse", fixture.text);
+}
+BENCHMARK(BM_json_parse_native)->Arg(10000)->Arg(40000)->Unit(benchmark::kMillisecond);
+
+static void BM_json_parse_ruby(benchmark::State& state) {
+    json_fixture fixture(state.range(0));
+    fixture.run(state, "PureJSON", "parse", fixture.text);
+}
+BENCHMARK(BM_json_parse_ruby)->Arg(10000)->Arg(40000)->Unit(benchmark::kMillisecond);
+
+static void BM_json_generate_native(benchmark::State& state) {
+    json_fixture fixture(state.range(0));
+    fixture.run(state, "JSON", "generate", fixture.document);
+}
+BENCHMARK(BM_json_generate_native)->Arg(10000)->Arg(40000)->Unit(benchmark::kMillisecond);
+
+static void BM_json_generate_ruby(benchmark::State& state) {
+    json_fixture fixture(state.range(0));
+    fixture.run(state, "PureJSON", "generate", fixture.document);
+}
+BENCHMARK(BM_json_generate_ruby)->Arg(10000)->Arg(40000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
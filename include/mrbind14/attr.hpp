@@ -0,0 +1,235 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_ATTR_H_
+#define MRBIND14_ATTR_H_
+
+#include <mrbind14/type_binder.hpp>
+#include <mruby.h>
+#include <mruby/hash.h>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <type_traits>
+
+namespace mrbind14 {
+
+class arg_v;
+
+/**
+ * @brief Annotation naming a parameter of a bound function, so that
+ * it can be passed as a keyword argument. Annotations are matched to
+ * parameters in order, starting from the first one:
+ *
+ *   mod.def_function("f", f, arg("x"), arg("y") = 2);
+ */
+class arg {
+
+  public:
+
+  explicit arg(const char* name)
+  : m_name(name) {}
+
+  template<typename T>
+  arg_v operator=(T&& value) const;
+
+  const char* name() const {
+    return m_name;
+  }
+
+  private:
+
+  const char* m_name;
+};
+
+/**
+ * @brief Annotation naming a parameter and giving it a default value.
+ * Created by assigning a value to an arg.
+ */
+class arg_v : public arg {
+
+  public:
+
+  template<typename T>
+  arg_v(const arg& a, T&& value)
+  : arg(a) {
+    using value_type = std::decay_t<T>;
+    value_type v(std::forward<T>(value));
+    m_make_value = [v](mrb_state* mrb) {
+      return detail::cpp_to_mrb<value_type>(mrb, v);
+    };
+  }
+
+  /// Converts the default value into an mrb_value for the given state
+  mrb_value value(mrb_state* mrb) const {
+    return m_make_value(mrb);
+  }
+
+  private:
+
+  std::function<mrb_value(mrb_state*)> m_make_value;
+};
+
+template<typename T>
+arg_v arg::operator=(T&& value) const {
+  return arg_v(*this, std::forward<T>(value));
+}
+
+namespace detail {
+
+/// Counts the arg and arg_v annotations in a list of extra attributes
+template<typename ... Extra>
+struct count_args;
+
+template<>
+struct count_args<> {
+  static constexpr size_t value = 0;
+};
+
+template<typename E1, typename ... Extra>
+struct count_args<E1, Extra...> {
+  static constexpr size_t value =
+    (std::is_base_of<arg, E1>::value ? 1 : 0) + count_args<Extra...>::value;
+};
+
+inline void set_return_value_policy(return_value_policy& result, return_value_policy policy) {
+  result = policy;
+}
+
+template<typename T>
+void set_return_value_policy(return_value_policy&, const T&) {}
+
+/// Returns the last return_value_policy among a list of extra
+/// attributes, or return_value_policy::automatic if there is none
+template<typename ... Extra>
+return_value_policy find_return_value_policy(const Extra&... extra) {
+  return_value_policy result = return_value_policy::automatic;
+  int dummy[] = { 0, (set_return_value_policy(result, extra), 0)... };
+  (void)dummy;
+  return result;
+}
+
+/// Maps the keyword and default arguments of a bound function to its
+/// parameter slots. The annotations are collected when the function is
+/// created and resolved into symbols and mrb_values once, when it is
+/// registered in an interpreter. A call iterates its keyword arguments
+/// once, comparing each key with the symbols of the parameters not
+/// passed positionally. The keyword arguments themselves still arrive
+/// in a Hash allocated by the VM.
+template<typename ... P>
+class argument_table {
+
+  static constexpr size_t N = sizeof...(P);
+
+  public:
+
+  template<typename ... Extra>
+  void process(const Extra&... extra) {
+    static_assert(count_args<Extra...>::value <= N,
+        "More arg annotations than function parameters");
+    int dummy[] = { 0, (add(extra), 0)... };
+    (void)dummy;
+  }
+
+  void initialize(mrb_state* mrb) {
+    for(size_t i = 0; i < N; i++) {
+      m_symbols[i]  = m_names[i] ? mrb_intern_cstr(mrb, m_names[i]) : 0;
+      m_defaults[i] = mrb_undef_value();
+      if(m_makers[i]) {
+        m_defaults[i] = m_makers[i](mrb);
+        mrb_gc_register(mrb, m_defaults[i]);
+      }
+    }
+  }
+
+  /// Binds the arguments of a call to the parameter slots. Returns args
+  /// when they can be used as-is, slots when they had to be filled with
+  /// keyword or default arguments, and nullptr if they don't match.
+  mrb_value* bind(mrb_state* mrb, unsigned nargs, mrb_value* args, mrb_value* slots) const {
+    if(!m_named) return nargs == N ? args : nullptr;
+    // a trailing Hash holds keyword arguments, unless it fills
+    // the last parameter and this parameter accepts a Hash
+    mrb_value kwargs = mrb_nil_value();
+    unsigned npos = nargs;
+    if(nargs > 0 && mrb_hash_p(args[nargs-1])
+    && (nargs > N || !accepts(mrb, nargs-1, args[nargs-1]))) {
+      kwargs = args[nargs-1];
+      npos  -= 1;
+    }
+    if(npos > N) return nullptr;
+    if(npos == N && mrb_nil_p(kwargs)) return args;
+    std::copy(args, args + npos, slots);
+    std::fill(slots + npos, slots + N, mrb_undef_value());
+    if(!mrb_nil_p(kwargs)) {
+      keyword_context ctx = { this, npos, slots, true };
+      mrb_hash_foreach(mrb, RHASH(kwargs), &match_keyword, &ctx);
+      if(!ctx.matched) return nullptr;
+    }
+    for(size_t i = npos; i < N; i++) {
+      if(mrb_undef_p(slots[i])) slots[i] = m_defaults[i];
+      if(mrb_undef_p(slots[i])) return nullptr;
+    }
+    return slots;
+  }
+
+  private:
+
+  struct keyword_context {
+    const argument_table* table;
+    size_t                first;
+    mrb_value*            slots;
+    bool                  matched;
+  };
+
+  /// Stores a keyword argument in the slot of its parameter. Keywords
+  /// that are unknown or given for positional parameters stop the
+  /// iteration and make the call fail to bind.
+  static int match_keyword(mrb_state*, mrb_value key, mrb_value val, void* data) {
+    auto ctx = static_cast<keyword_context*>(data);
+    if(mrb_symbol_p(key)) {
+      mrb_sym sym = mrb_symbol(key);
+      for(size_t i = ctx->first; i < N; i++) {
+        if(ctx->table->m_symbols[i] != sym) continue;
+        ctx->slots[i] = val;
+        return 0;
+      }
+    }
+    ctx->matched = false;
+    return 1;
+  }
+
+  using checker = bool(*)(mrb_state*, mrb_value);
+
+  static bool accepts(mrb_state* mrb, size_t i, mrb_value val) {
+    static const std::array<checker, N> checks = {{ &check_type<std::decay_t<P>>... }};
+    return checks[i](mrb, val);
+  }
+
+  void add(const arg& a) {
+    m_names[m_count++] = a.name();
+    m_named = true;
+  }
+
+  void add(const arg_v& a) {
+    m_makers[m_count] = [a](mrb_state* mrb) { return a.value(mrb); };
+    add(static_cast<const arg&>(a));
+  }
+
+  template<typename T>
+  void add(const T&) {}
+
+  bool   m_named = false;
+  size_t m_count = 0;
+  std::array<const char*, N> m_names = {};
+  std::array<std::function<mrb_value(mrb_state*)>, N> m_makers;
+  std::array<mrb_sym, N>     m_symbols = {};
+  std::array<mrb_value, N>   m_defaults;
+};
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
@@ -0,0 +1,212 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_BLOCK_H_
+#define MRBIND14_BLOCK_H_
+
+#include <mrbind14/type_binder.hpp>
+#include <mruby.h>
+#include <type_traits>
+#include <utility>
+
+namespace mrbind14 {
+
+template<typename ... A>
+class block_invoker;
+
+/// The block class gives bound functions access to the block of the
+/// call: a bound function whose last parameter is a block receives the
+/// block given in Ruby, or an empty block if there is none.
+///
+///   mod.def_function("each_row", [&](block b) {
+///     auto yield = b.invoker<int, const char*>();
+///     for(auto& row : rows) yield(row.id, row.name);
+///   });
+///
+/// A break, a return or an exception raised in the block leaves the
+/// bound function from inside the yield. Unless mruby is built with
+/// MRB_ENABLE_CXX_EXCEPTION, this is a longjmp: the C++ frames between
+/// the yield and the Ruby caller are skipped without running
+/// destructors, including those of the function's locals and of its
+/// converted arguments. On such builds, a function taking a block must
+/// not hold anything with a non-trivial destructor across a yield
+/// (std::string, containers, smart pointers, locks, ...): take strings
+/// as const char*, and keep state in the function's captures or in
+/// Ruby objects. The binding layer enforces this for the parameters of
+/// the function, and keeps no such object in the frames of the call.
+class block {
+
+  public:
+
+  block() = default;
+
+  block(mrb_state* mrb, mrb_value proc)
+  : m_mrb(mrb), m_proc(proc) {}
+
+  explicit operator bool() const {
+    return m_mrb && !mrb_nil_p(m_proc);
+  }
+
+  mrb_state* mrb() const {
+    return m_mrb;
+  }
+
+  mrb_value value() const {
+    return m_proc;
+  }
+
+  /// Calls the block once. Arguments are converted to Ruby values, and
+  /// the result stays protected until the bound function returns.
+  template<typename ... A>
+  mrb_value operator()(const A&... args) const {
+    check();
+    mrb_value argv[sizeof...(A) + 1] = { detail::cpp_to_mrb(m_mrb, args)... };
+    return mrb_yield_argv(m_mrb, m_proc, sizeof...(A), argv);
+  }
+
+  /// Returns an invoker calling the block repeatedly with arguments
+  /// of types A..., for use in loops (see block_invoker).
+  template<typename ... A>
+  block_invoker<A...> invoker() const {
+    return block_invoker<A...>(*this);
+  }
+
+  /// Raises a LocalJumpError if no block was given
+  void check() const {
+    if(*this) return;
+    mrb_state* mrb = m_mrb;
+    mrb_raise(mrb, E_LOCALJUMP_ERROR, "no block given (yield)");
+  }
+
+  private:
+
+  mrb_state* m_mrb  = nullptr;
+  mrb_value  m_proc = mrb_nil_value();
+};
+
+/// Calls a block repeatedly from a C++ loop. The arguments of each call
+/// are converted into a buffer reused across calls, and the GC arena is
+/// restored before each call to its level at the creation of the
+/// invoker: objects created by a call (its arguments and result) stay
+/// protected until the next call, so the arena does not grow with the
+/// number of iterations. The bound function restores the arena when it
+/// returns. Arguments of type mrb_value are passed as is,
+/// which allows converting loop-invariant arguments only once, before
+/// creating the invoker. Invokers are trivially destructible, so that
+/// they can be left by a break (see block).
+template<typename ... A>
+class block_invoker {
+
+  static constexpr size_t N = sizeof...(A);
+
+  public:
+
+  explicit block_invoker(const block& b)
+  : m_mrb(b.mrb()), m_proc(b.value()) {
+    b.check();
+    m_arena = mrb_gc_arena_save(m_mrb);
+  }
+
+  block_invoker(block_invoker&&) = default;
+
+  block_invoker(const block_invoker&) = delete;
+
+  block_invoker& operator=(const block_invoker&) = delete;
+
+  block_invoker& operator=(block_invoker&&) = delete;
+
+  mrb_value operator()(const A&... args) {
+    mrb_gc_arena_restore(m_mrb, m_arena);
+    assign(std::index_sequence_for<A...>(), args...);
+    return mrb_yield_argv(m_mrb, m_proc, N, m_args);
+  }
+
+  private:
+
+  template<size_t ... I>
+  void assign(std::index_sequence<I...>, const A&... args) {
+    int dummy[] = { 0, (m_args[I] = detail::cpp_to_mrb(m_mrb, args), 0)... };
+    (void)dummy;
+  }
+
+  mrb_state* m_mrb;
+  mrb_value  m_proc;
+  int        m_arena = 0;
+  mrb_value  m_args[N + 1];
+};
+
+static_assert(std::is_trivially_destructible<block_invoker<int, const char*>>::value,
+    "block_invoker must be trivially destructible");
+
+namespace detail {
+
+template<typename T>
+using is_block = std::is_same<std::decay_t<T>, block>;
+
+/// Counts the block parameters of a function
+template<typename ... P>
+struct count_blocks;
+
+template<>
+struct count_blocks<> {
+  static constexpr size_t value = 0;
+};
+
+template<typename P1, typename ... P>
+struct count_blocks<P1, P...> {
+  static constexpr size_t value = (is_block<P1>::value ? 1 : 0) + count_blocks<P...>::value;
+};
+
+/// Whether the last parameter of a function is a block, in which case
+/// it receives the block of the call rather than a positional argument
+template<typename ... P>
+struct takes_block : std::false_type {};
+
+template<typename P1>
+struct takes_block<P1> : is_block<P1> {};
+
+template<typename P1, typename P2, typename ... P>
+struct takes_block<P1, P2, P...> : takes_block<P2, P...> {};
+
+/// Checks that none of the types needs destruction, i.e. that values of
+/// these types may be skipped by a break in a block
+template<typename ... T>
+struct are_trivially_destructible;
+
+template<>
+struct are_trivially_destructible<> : std::true_type {};
+
+template<typename T1, typename ... T>
+struct are_trivially_destructible<T1, T...>
+  : std::integral_constant<bool, std::is_trivially_destructible<std::decay_t<T1>>::value
+                              && are_trivially_destructible<T...>::value> {};
+
+template<>
+struct type_binder<block> {
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, const block& b) {
+    return b.value();
+  }
+
+  static block mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    return block(mrb, val);
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return mrb_nil_p(val) || mrb_proc_p(val);
+  }
+};
+
+template<>
+struct static_type_name<block> {
+  static constexpr bool available = true;
+  static constexpr auto name() { return make_static_string("block"); }
+};
+
+} // namespace detail
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_CLASS_H_
+#define MRBIND14_CLASS_H_
+
+#include <mrbind14/module.hpp>
+#include <mrbind14/cpp_function.hpp>
+#include <mrbind14/instance.hpp>
+#include <mrbind14/state.hpp>
+#include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <memory>
+#include <typeindex>
+
+namespace mrbind14 {
+
+/**
+ * @brief Ruby class bound to the C++ type T. Objects of this class
+ * hold a T, which is reachable from the methods defined with def_method.
+ *
+ * @tparam T C++ type.
+ */
+template<typename T>
+class class_ : public module {
+
+    friend class module;
+
+    public:
+
+    /**
+     * @brief Defines a method of the class. The function can be a
+     * pointer to a (const) member function of T, or any callable
+     * taking a T& (or const T&) as first parameter.
+     *
+     * @param name Name of the method.
+     * @param f Function.
+     * @param extra Annotations (e.g. arg).
+     *
+     * @return A reference to the current class.
+     */
+    template<typename Function, typename ... Extra>
+    class_& def_method(const char* name, Function&& f, const Extra&... extra) {
+        return define(name, detail::make_method<T>(std::forward<Function>(f), extra...));
+    }
+
+    /**
+     * @brief Defines the initialize method of the class, constructing
+     * the T from the arguments.
+     *
+     * @tparam P Types of the parameters of T's constructor.
+     * @param extra Annotations (e.g. arg).
+     *
+     * @return A reference to the current class.
+     */
+    template<typename ... P, typename ... Extra>
+    class_& def_init(const Extra&... extra) {
+        return define("initialize", detail::make_constructor<T, P...>(extra...));
+    }
+
+    private:
+
+    class_(mrb_state* mrb, struct RClass* cls, const char* name)
+    : module(mrb, cls, name) {}
+
+    class_& define(const char* name, std::unique_ptr<detail::abstract_function> impl) {
+        auto& functions = detail::get_state_data(m_mrb).functions;
+        functions.push_back(std::make_unique<function>(name, std::move(impl)));
+        auto fptr = functions.back().get();
+        fptr->initialize(m_mrb);
+        detail::define_method(m_mrb, m_module, name, fptr);
+        return *this;
+    }
+};
+
+template<typename T>
+class_<T> module::def_class(const char* name) {
+    struct RClass* cls = mrb_define_class_under(m_mrb, m_module, name, m_mrb->object_class);
+    MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+    detail::get_state_data(m_mrb).classes[typeid(T)] = cls;
+    detail::register_cpp_class_name<T>(m_mrb, name);
+    return class_<T>(m_mrb, cls, name);
+}
+
+}
+
+#endif
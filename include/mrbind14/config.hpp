@@ -0,0 +1,29 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_CONFIG_H_
+#define MRBIND14_CONFIG_H_
+
+/// mrbind14 is header-only by default. When MRBIND14_COMPILED_LIBRARY
+/// is defined (by linking with the mrbind14_compiled CMake target), the
+/// headers only declare the non-template functions marked MRBIND14_INLINE,
+/// and src/mrbind14.cpp, which defines MRBIND14_IMPLEMENTATION, compiles
+/// them once along with the common type_binder instantiations.
+///
+/// MRBIND14_DEFINITIONS tells whether the headers must provide these
+/// definitions in the current translation unit.
+#if defined(MRBIND14_COMPILED_LIBRARY)
+#define MRBIND14_INLINE
+#if defined(MRBIND14_IMPLEMENTATION)
+#define MRBIND14_DEFINITIONS 1
+#else
+#define MRBIND14_DEFINITIONS 0
+#endif
+#else
+#define MRBIND14_INLINE inline
+#define MRBIND14_DEFINITIONS 1
+#endif
+
+#endif
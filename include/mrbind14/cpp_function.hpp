@@ -3,23 +3,36 @@
 
 #include <mrbind14/type_traits.hpp>
 #include <mrbind14/type_binder.hpp>
+#include <mrbind14/signature.hpp>
+#include <mrbind14/attr.hpp>
+#include <mrbind14/memoize.hpp>
+#include <mrbind14/profiler.hpp>
+#include <mrbind14/gc.hpp>
+#include <mrbind14/state.hpp>
 #include <mruby.h>
+#include <mruby/proc.h>
+#include <algorithm>
+#include <tuple>
 #include <vector>
 #include <functional>
 #include <iostream>
+#include <memory>
 
 namespace mrbind14 {
 
 namespace detail {
 
 /// Helper structure that makes a function return the ruby nil
-/// value if the C function returns void
+/// value if the C function returns void. Other results are converted
+/// by return_caster according to the return value policy, parent
+/// being the receiver of the call.
 template<typename Function>
 struct make_function_return_mrb_value {};
 
 template<typename ... P>
 struct make_function_return_mrb_value<std::function<void(P...)>> {
-  static mrb_value call(mrb_state*, const std::function<void(P...)>& f, P&&... params) {
+  static mrb_value call(mrb_state*, return_value_policy, mrb_value,
+                        const std::function<void(P...)>& f, P&&... params) {
     f(std::forward<P>(params)...);
     return mrb_nil_value();
   }
@@ -27,8 +40,69 @@ struct make_function_return_mrb_value<std::function<void(P...)>> {
 
 template<typename R, typename ... P>
 struct make_function_return_mrb_value<std::function<R(P...)>> {
-  static mrb_value call(mrb_state* mrb, const std::function<R(P...)>& f, P&&... params) {
-    return cpp_to_mrb<R>(mrb, f(std::forward<P>(params)...) );
+  static mrb_value call(mrb_state* mrb, return_value_policy policy, mrb_value parent,
+                        const std::function<R(P...)>& f, P&&... params) {
+    return return_caster<R>::cast(mrb, f(std::forward<P>(params)...), policy, parent);
+  }
+};
+
+/// Helper structure defining how the Ruby receiver (self) of a call
+/// is passed to the bound C++ callable. For methods of bound classes,
+/// Self is the (possibly const) class, and the C++ object is retrieved
+/// with a single mrb_data_type pointer comparison.
+template<typename Self>
+struct self_binder {
+
+  template<typename R, typename ... P>
+  using function_type = std::function<R(Self&, P...)>;
+
+  static Self* get(mrb_value& self) {
+    return get_instance_ptr<std::remove_const_t<Self>>(self);
+  }
+
+  template<typename Function, typename ... A>
+  static mrb_value call(mrb_state* mrb, return_value_policy policy, mrb_value self,
+                        const Function& f, Self* target, A&&... args) {
+    return make_function_return_mrb_value<Function>::call(
+        mrb, policy, self, f, *target, std::forward<A>(args)...);
+  }
+};
+
+/// Free functions ignore self
+template<>
+struct self_binder<void> {
+
+  template<typename R, typename ... P>
+  using function_type = std::function<R(P...)>;
+
+  static bool get(mrb_value&) {
+    return true;
+  }
+
+  template<typename Function, typename ... A>
+  static mrb_value call(mrb_state* mrb, return_value_policy policy, mrb_value self,
+                        const Function& f, bool, A&&... args) {
+    return make_function_return_mrb_value<Function>::call(
+        mrb, policy, self, f, std::forward<A>(args)...);
+  }
+};
+
+/// Functions defining initialize receive the uninitialized Ruby object
+template<>
+struct self_binder<mrb_value> {
+
+  template<typename R, typename ... P>
+  using function_type = std::function<R(mrb_state*, mrb_value, P...)>;
+
+  static mrb_value* get(mrb_value& self) {
+    return mrb_type(self) == MRB_TT_DATA ? &self : nullptr;
+  }
+
+  template<typename Function, typename ... A>
+  static mrb_value call(mrb_state* mrb, return_value_policy policy, mrb_value self,
+                        const Function& f, mrb_value* target, A&&... args) {
+    return make_function_return_mrb_value<Function>::call(
+        mrb, policy, self, f, std::move(mrb), std::move(*target), std::forward<A>(args)...);
   }
 };
 
@@ -48,63 +122,250 @@ class abstract_function {
 
     virtual ~abstract_function() = default;
 
-    virtual mrb_value call(mrb_state* mrb, unsigned nargs, mrb_value* args) const = 0;
+    virtual void initialize(mrb_state* mrb) {}
+
+    /// Calls the function with the arguments and block (nil if none)
+    /// of a Ruby call
+    virtual mrb_value call(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args, mrb_value blk) const = 0;
+
+    virtual bool check_args(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args, mrb_value blk) const = 0;
+
+    /// Returns the signature of the function, e.g. "(int, string) -> bool"
+    virtual const char* signature(mrb_state* mrb) const = 0;
+
+    /// Returns the result cache of a memoized function, nullptr otherwise
+    virtual memo_cache* cache() const {
+        return nullptr;
+    }
+
+#if MRBIND14_ENABLE_PROFILING
+    /// Returns the counters of the calls, which implementations made of
+    /// several functions merge
+    virtual call_stats stats() const {
+        return m_stats;
+    }
+
+    virtual void reset_stats() {
+        m_stats = call_stats();
+    }
+
+    // m_stats is aligned on a cache line, which operator new does not
+    // honor before C++17
+    static void* operator new(size_t size) {
+        return allocate_aligned(size, alignof(call_stats));
+    }
+
+    static void operator delete(void* ptr) {
+        free_aligned(ptr);
+    }
 
-    virtual bool check_args(mrb_state* mrb, unsigned nargs, mrb_value* args) const = 0;
+    protected:
 
-    virtual std::string signature(mrb_state* mrb) const = 0;
+    mutable call_stats m_stats;
+#endif
 
 };
 
-template<typename F>
+/// Implementation of a bound callable taking parameters P... from
+/// the Ruby arguments and, unless Self is void, the C++ object (or
+/// Ruby object) from the receiver of the call (see self_binder).
+/// If the last parameter is a block, it receives the block of the call.
+template<typename F, typename Self = void>
 class function_impl;
 
-template<typename R, typename ... P>
-class function_impl<R(P...)> : public abstract_function {
-    
+/// Argument table of the first N parameters of a function
+template<typename Tuple, typename Indices>
+struct positional_argument_table;
+
+template<typename Tuple, size_t ... I>
+struct positional_argument_table<Tuple, std::index_sequence<I...>> {
+    using type = argument_table<std::tuple_element_t<I, Tuple>...>;
+};
+
+template<typename R, typename ... P, typename Self>
+class function_impl<R(P...), Self> : public abstract_function {
+
+    using function_type = typename self_binder<Self>::template function_type<R, P...>;
+
+    static constexpr bool   has_block      = takes_block<P...>::value;
+    static constexpr size_t num_positional = sizeof...(P) - (has_block ? 1 : 0);
+
+    static_assert(count_blocks<P...>::value == (has_block ? 1 : 0),
+        "A block parameter must be the last parameter of a function");
+
+#ifndef MRB_ENABLE_CXX_EXCEPTION
+    // A break in the block longjmps over the frames of the call, so the
+    // converted arguments must not need destruction (see block)
+    static_assert(!has_block || are_trivially_destructible<converted_t<P>...>::value,
+        "Without MRB_ENABLE_CXX_EXCEPTION, the parameters of a function taking a block "
+        "must convert to trivially destructible types (e.g. const char* for strings)");
+#endif
+
+    using argument_table_type = typename positional_argument_table<
+        std::tuple<P...>, std::make_index_sequence<num_positional>>::type;
+
     public:
 
     template<typename ... Extra>
-    function_impl(std::function<R(P...)>&& fun, const Extra&... extra)
-    : m_function(std::move(fun)) {}
+    function_impl(function_type&& fun, const Extra&... extra)
+    : m_function(std::move(fun)) {
+        static_assert(!has_memoize<Extra...>::value || (std::is_void<Self>::value && !has_block),
+            "Only free functions without a block parameter can be memoized");
+        m_arguments.process(extra...);
+        m_policy = find_return_value_policy(extra...);
+        size_t capacity = find_memoize_capacity(extra...);
+        if(capacity) m_cache = std::make_unique<memo_cache>(capacity);
+    }
     
     template<typename ... Extra>
-    function_impl(const std::function<R(P...)>& fun, const Extra&... extra)
-    : function_impl(std::function<R(P...)>(fun), extra...) {}
+    function_impl(const function_type& fun, const Extra&... extra)
+    : function_impl(function_type(fun), extra...) {}
+
+    void initialize(mrb_state* mrb) override {
+        m_arguments.initialize(mrb);
+        if(m_cache) m_cache->initialize(mrb);
+    }
 
-    mrb_value call(mrb_state* mrb, unsigned nargs, mrb_value* args) const override {
-        if(!check_args(mrb, nargs, args)) throw std::bad_function_call();
-        return apply_function(mrb, args, std::index_sequence_for<P...>());
+    mrb_value call(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args, mrb_value blk) const override {
+        auto target = self_binder<Self>::get(self);
+        if(!target) throw std::bad_function_call();
+        mrb_value slots[sizeof...(P) + 1];
+        mrb_value* bound = bind(mrb, nargs, args, blk, slots);
+        if(!bound || !check_arg_types<P...>(mrb, bound, false)) throw std::bad_function_call();
+        return call_bound(mrb, self, target, bound, std::integral_constant<bool, has_block>());
     }
 
-    bool check_args(mrb_state* mrb, unsigned nargs, mrb_value* args) const override {
-        if(nargs != sizeof...(P)) return false;
-        return check_arg_types<P...>(mrb, args, false);
+    bool check_args(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args, mrb_value blk) const override {
+        if(!self_binder<Self>::get(self)) return false;
+        mrb_value slots[sizeof...(P) + 1];
+        mrb_value* bound = bind(mrb, nargs, args, blk, slots);
+        if(!bound) return false;
+        return check_arg_types<P...>(mrb, bound, false);
     }
 
-    std::string signature(mrb_state* mrb) const override {
-        std::string result = "(";
-        std::vector<std::string> arg_types =
-            { get_cpp_class_name<P>(mrb)... };
-        auto i = arg_types.size();
-        for(const auto& arg_type : arg_types) {
-            i -= 1;
-            result += arg_type;
-            if(i != 0) result += ", ";
+    const char* signature(mrb_state* mrb) const override {
+        return signature(mrb, all_static_names<R, P...>());
+    }
+
+    memo_cache* cache() const override {
+        return m_cache.get();
+    }
+
+    private:
+
+    template<typename Target>
+    mrb_value call_bound(mrb_state* mrb, mrb_value self, Target target, mrb_value* args, std::false_type) const {
+        gc_arena_scope arena(mrb);
+        if(m_cache) return arena.escape(call_memoized(mrb, self, target, args));
+        return arena.escape(
+            apply_function(mrb, self, target, args, std::index_sequence_for<P...>(), profiling_enabled()));
+    }
+
+    /// A break in the block leaves the call without running destructors,
+    /// so the arena is saved and restored by hand rather than by a scope
+    template<typename Target>
+    mrb_value call_bound(mrb_state* mrb, mrb_value self, Target target, mrb_value* args, std::true_type) const {
+        int ai = mrb_gc_arena_save(mrb);
+        mrb_value result;
+        try {
+            result = apply_function(mrb, self, target, args, std::index_sequence_for<P...>(), profiling_enabled());
+        } catch(...) {
+            mrb_gc_arena_restore(mrb, ai);
+            throw;
         }
-        result += ") -> " + get_cpp_class_name<R>(mrb);
+        mrb_gc_arena_restore(mrb, ai);
+        mrb_gc_protect(mrb, result);
         return result;
     }
 
-    private:
+    /// Looks up the arguments in the cache before calling the function,
+    /// so that a hit skips both the conversions and the call. The key is
+    /// built in the cache's buffer, unless the function is running and
+    /// calls itself through Ruby, in which case the outer call still
+    /// needs that buffer for its own key. Hits are profiled as calls
+    /// without conversion time.
+    template<typename Target>
+    mrb_value call_memoized(mrb_state* mrb, mrb_value self, Target target, mrb_value* args) const {
+#if MRBIND14_ENABLE_PROFILING
+        call_timer<true> timer;
+#endif
+        std::string nested;
+        std::string& key = m_cache->running() ? nested : m_cache->buffer();
+        if(!m_cache->make_key(num_positional, args, key))
+            return apply_function(mrb, self, target, args, std::index_sequence_for<P...>(), profiling_enabled());
+        mrb_value result;
+        if(m_cache->find(mrb, key, result)) {
+#if MRBIND14_ENABLE_PROFILING
+            timer.finish(m_stats);
+#endif
+            return result;
+        }
+        m_cache->enter();
+        try {
+            result = apply_function(mrb, self, target, args, std::index_sequence_for<P...>(), profiling_enabled());
+        } catch(...) {
+            m_cache->leave();
+            throw;
+        }
+        m_cache->leave();
+        m_cache->insert(mrb, key, result);
+        return result;
+    }
 
-    template<size_t ... I>
-    mrb_value apply_function(mrb_state* mrb, mrb_value* args, std::index_sequence<I...>) const {
-        return make_function_return_mrb_value<decltype(m_function)>::call(
-            mrb, m_function, type_converter<P>::convert(mrb, args[I])...);
+    /// Binds the arguments to the positional parameters, then appends
+    /// the block for functions taking one
+    mrb_value* bind(mrb_state* mrb, unsigned nargs, mrb_value* args, mrb_value blk, mrb_value* slots) const {
+        mrb_value* bound = m_arguments.bind(mrb, nargs, args, slots);
+        if(!has_block || !bound) return bound;
+        if(bound != slots) std::copy(bound, bound + num_positional, slots);
+        slots[num_positional] = blk;
+        return slots;
     }
 
-    std::function<R(P...)> m_function;
+    // Signatures made only of built-in types are generated at compile
+    // time; others depend on the names registered in mrb and are built
+    // on first use, then again whenever a name is registered.
+
+    const char* signature(mrb_state* mrb, std::true_type) const {
+        return static_signature<R, P...>::value.c_str();
+    }
+
+    const char* signature(mrb_state* mrb, std::false_type) const {
+        auto version = get_state_data(mrb).class_names_version;
+        if(m_signature.empty() || m_signature_version != version) {
+            m_signature         = make_signature<R, P...>(mrb);
+            m_signature_version = version;
+        }
+        return m_signature.c_str();
+    }
+
+    template<typename Target, size_t ... I>
+    mrb_value apply_function(mrb_state* mrb, mrb_value self, Target target, mrb_value* args, std::index_sequence<I...>, std::false_type) const {
+        return self_binder<Self>::call(
+            mrb, m_policy, self, m_function, target, type_converter<P>::convert(mrb, args[I])...);
+    }
+
+#if MRBIND14_ENABLE_PROFILING
+    // Profiled version: arguments are converted upfront so that the
+    // conversion time can be measured separately from the callee.
+    template<typename Target, size_t ... I>
+    mrb_value apply_function(mrb_state* mrb, mrb_value self, Target target, mrb_value* args, std::index_sequence<I...>, std::true_type) const {
+        call_timer<true> timer;
+        std::tuple<converted_t<P>...> converted{ type_converter<P>::convert(mrb, args[I])... };
+        timer.converted();
+        auto result = self_binder<Self>::call(
+            mrb, m_policy, self, m_function, target, std::forward<P>(std::get<I>(converted))...);
+        timer.finish(m_stats);
+        return result;
+    }
+#endif
+
+    function_type               m_function;
+    argument_table_type         m_arguments;
+    return_value_policy         m_policy = return_value_policy::automatic;
+    mutable std::string         m_signature;
+    mutable uint64_t            m_signature_version = 0;
+    std::unique_ptr<memo_cache> m_cache;
 };
 
 // Make a function from a std::function rvalue ref
@@ -141,6 +402,65 @@ make_function(Function f, const Extra&... extra) {
     return std::make_unique<function_type>(std_function_type(std::forward<Function>(f)), extra...);
 } 
 
+/// Helper structure splitting the signature of a callable taking
+/// a reference to a C++ object as first parameter
+template<typename Signature>
+struct method_signature {};
+
+template<typename R, typename C, typename ... P>
+struct method_signature<R(C&, P...)> {
+    using self_type     = C;
+    using function_type = R(P...);
+};
+
+// Make a method of class T from a member function pointer
+template<typename T, typename R, typename C, typename ... P, typename ... Extra>
+std::unique_ptr<abstract_function>
+make_method(R (C::*f)(P...), const Extra&... extra) {
+    using function_type = function_impl<R(P...), T>;
+    return std::make_unique<function_type>(
+        std::function<R(T&, P...)>([f](T& self, P... params) -> R {
+            return (self.*f)(std::forward<P>(params)...);
+        }), extra...);
+}
+
+// Make a method of class T from a const member function pointer
+template<typename T, typename R, typename C, typename ... P, typename ... Extra>
+std::unique_ptr<abstract_function>
+make_method(R (C::*f)(P...) const, const Extra&... extra) {
+    using function_type = function_impl<R(P...), const T>;
+    return std::make_unique<function_type>(
+        std::function<R(const T&, P...)>([f](const T& self, P... params) -> R {
+            return (self.*f)(std::forward<P>(params)...);
+        }), extra...);
+}
+
+// Make a method of class T from a callable taking a T& (or const T&)
+// as first parameter
+template<typename T, typename Function, typename ... Extra>
+std::enable_if_t<!std::is_member_function_pointer<std::decay_t<Function>>::value,
+    std::unique_ptr<abstract_function>>
+make_method(Function&& f, const Extra&... extra) {
+    using signature     = method_signature<function_signature_t<std::decay_t<Function>>>;
+    using self_type     = typename signature::self_type;
+    static_assert(std::is_same<std::remove_const_t<self_type>, T>::value,
+        "The first parameter of a method must be a reference to its class");
+    using function_type = function_impl<typename signature::function_type, self_type>;
+    using std_function_type = std::function<function_signature_t<std::decay_t<Function>>>;
+    return std::make_unique<function_type>(std_function_type(std::forward<Function>(f)), extra...);
+}
+
+// Make the initialize method of class T from the types of its constructor's parameters
+template<typename T, typename ... P, typename ... Extra>
+std::unique_ptr<abstract_function>
+make_constructor(const Extra&... extra) {
+    using function_type = function_impl<void(P...), mrb_value>;
+    return std::make_unique<function_type>(
+        std::function<void(mrb_state*, mrb_value, P...)>([](mrb_state* mrb, mrb_value self, P... params) {
+            initialize_instance(mrb, self, std::make_shared<T>(std::forward<P>(params)...));
+        }), extra...);
+}
+
 } // namespace detail
 
 class function {
@@ -154,6 +474,10 @@ class function {
     : m_name(std::move(name))
     , m_impl(detail::make_function(fun, extra...)) {}
 
+    function(std::string name, std::unique_ptr<detail::abstract_function> impl)
+    : m_name(std::move(name))
+    , m_impl(std::move(impl)) {}
+
     function(const function& other) = delete;
 
     function(function&&) = default;
@@ -164,25 +488,70 @@ class function {
 
     ~function() = default;
 
-    mrb_value call(mrb_state* mrb, unsigned nargs, mrb_value* args) const {
-        if(m_impl) return m_impl->call(mrb, nargs, args);
+    void initialize(mrb_state* mrb) {
+        if(m_impl) m_impl->initialize(mrb);
+    }
+
+    mrb_value call(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args,
+                   mrb_value blk = mrb_nil_value()) const {
+        if(m_impl) return m_impl->call(mrb, self, nargs, args, blk);
         else throw std::bad_function_call();
     }
 
-    bool check_args(mrb_state* mrb, unsigned nargs, mrb_value* args) const {
-        if(m_impl) return m_impl->check_args(mrb, nargs, args);
+    bool check_args(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args,
+                    mrb_value blk = mrb_nil_value()) const {
+        if(m_impl) return m_impl->check_args(mrb, self, nargs, args, blk);
         else return false;
     }
 
-    std::string signature(mrb_state* mrb) const {
+    const char* signature(mrb_state* mrb) const {
         if(m_impl) return m_impl->signature(mrb);
-        else return std::string();
+        else return "";
     }
 
     const std::string& name() const {
         return m_name;
     }
 
+    /// Returns whether the function was bound with a memoize annotation
+    bool memoized() const {
+        return m_impl && m_impl->cache();
+    }
+
+    /// Returns the counters of the cache of a memoized function
+    memo_stats memoize_stats() const {
+        memo_stats s;
+        if(memoized()) s = m_impl->cache()->stats();
+        s.name = m_name;
+        return s;
+    }
+
+    /// Empties the cache of a memoized function and resets its counters
+    void clear_memoized(mrb_state* mrb) {
+        if(!memoized()) return;
+        m_impl->cache()->clear(mrb);
+        m_impl->cache()->reset_stats();
+    }
+
+#if MRBIND14_ENABLE_PROFILING
+    function_profile profile() const {
+        function_profile p;
+        p.name = m_name;
+        if(m_impl) {
+            const auto& stats = m_impl->stats();
+            p.calls         = stats.calls;
+            p.total_ns      = stats.total_ns;
+            p.max_ns        = stats.max_ns;
+            p.conversion_ns = stats.conversion_ns;
+        }
+        return p;
+    }
+
+    void reset_profile() {
+        if(m_impl) m_impl->reset_stats();
+    }
+#endif
+
     private:
 
     std::string                                m_name;
@@ -190,26 +559,64 @@ class function {
 
 };
 
-inline mrb_value function_overload_resolver(mrb_state* mrb, mrb_value self) {
-    RClass* mod = mrb_class(mrb, self);
-    // get arguments
+/// Entry point of all the bound functions and methods: retrieves the
+/// function from the environment of the method's proc and calls it
+MRBIND14_INLINE mrb_value function_overload_resolver(mrb_state* mrb, mrb_value self);
+
+namespace detail {
+
+/// Creates a method calling fptr through function_overload_resolver.
+/// The function pointer is stored in the environment of the method's
+/// proc, so a call does not need any lookup to find it.
+MRBIND14_INLINE mrb_method_t make_method_entry(mrb_state* mrb, function* fptr);
+
+/// Defines fptr as an instance method of the class cls
+MRBIND14_INLINE void define_method(mrb_state* mrb, struct RClass* cls, const char* name, function* fptr);
+
+/// Defines fptr as a module function of the module mod
+MRBIND14_INLINE void define_module_function(mrb_state* mrb, struct RClass* mod, const char* name, function* fptr);
+
+} // namespace detail
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE mrb_value function_overload_resolver(mrb_state* mrb, mrb_value self) {
+    // get arguments and block
     mrb_value* args;
-    uint32_t narg;
-    mrb_get_args(mrb, "*", &args, &narg);
-    // get current method name
-    mrb_value kernel = mrb_class_find_path(mrb, mrb->kernel_module);
-    mrb_value fun_name_val = mrb_funcall(mrb, kernel, "__method__", 0);
-    std::string fun_name = detail::mrb_to_cpp<std::string>(mrb, fun_name_val);
-    // make instance name
-    std::string name_cptr = std::string("__") + fun_name + "__cptr__";
-    // retrieve function pointer
-    mrb_sym name_cptr_sym = mrb_intern_cstr(mrb, name_cptr.c_str());
-    mrb_value cptr_val = mrb_mod_cv_get(mrb, mod, name_cptr_sym);
-    auto fptr = static_cast<function*>(mrb_cptr(cptr_val));
+    mrb_int narg;
+    mrb_value blk;
+    mrb_get_args(mrb, "*&", &args, &narg, &blk);
+    // retrieve function pointer from the environment of the method's proc
+    auto fptr = static_cast<function*>(mrb_cptr(mrb_cfunc_env_get(mrb, 0)));
     // call the function
-    return fptr->call(mrb, narg, args);
+    return fptr->call(mrb, self, narg, args, blk);
+}
+
+namespace detail {
+
+MRBIND14_INLINE mrb_method_t make_method_entry(mrb_state* mrb, function* fptr) {
+    mrb_value env = mrb_cptr_value(mrb, fptr);
+    struct RProc* proc = mrb_proc_new_cfunc_with_env(mrb, function_overload_resolver, 1, &env);
+    mrb_method_t method;
+    MRB_METHOD_FROM_PROC(method, proc);
+    return method;
 }
 
+MRBIND14_INLINE void define_method(mrb_state* mrb, struct RClass* cls, const char* name, function* fptr) {
+    mrb_define_method_raw(mrb, cls, mrb_intern_cstr(mrb, name), make_method_entry(mrb, fptr));
+}
+
+MRBIND14_INLINE void define_module_function(mrb_state* mrb, struct RClass* mod, const char* name, function* fptr) {
+    mrb_sym sym = mrb_intern_cstr(mrb, name);
+    mrb_method_t method = make_method_entry(mrb, fptr);
+    mrb_define_class_method_raw(mrb, mod, sym, method);
+    mrb_define_method_raw(mrb, mod, sym, method);
+}
+
+} // namespace detail
+
+#endif
+
 } // namespace mrbind14
 
 #endif
@@ -0,0 +1,128 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_ENUM_H_
+#define MRBIND14_ENUM_H_
+
+#include <mrbind14/state.hpp>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mrbind14 {
+
+namespace detail {
+
+/// Enumerators of an enum bound with module::def_enum in a given state,
+/// sorted both by symbol and by value so that conversions in either
+/// direction are a binary search. Values are stored as int64_t.
+class enum_table {
+
+  public:
+
+  enum_table(std::vector<std::pair<mrb_sym, int64_t>> enumerators, bool flags)
+  : m_by_symbol(std::move(enumerators))
+  , m_flags(flags) {
+    std::sort(m_by_symbol.begin(), m_by_symbol.end());
+    for(const auto& e : m_by_symbol) {
+      m_by_value.emplace_back(e.second, e.first);
+      m_mask |= e.second;
+    }
+    std::sort(m_by_value.begin(), m_by_value.end());
+  }
+
+  bool flags() const {
+    return m_flags;
+  }
+
+  /// Finds the value of the enumerator named sym
+  bool find(mrb_sym sym, int64_t& value) const {
+    auto it = std::lower_bound(m_by_symbol.begin(), m_by_symbol.end(),
+        std::make_pair(sym, INT64_MIN));
+    if(it == m_by_symbol.end() || it->first != sym) return false;
+    value = it->second;
+    return true;
+  }
+
+  /// Finds the symbol of the enumerator of the given value, or returns 0
+  mrb_sym find(int64_t value) const {
+    auto it = std::lower_bound(m_by_value.begin(), m_by_value.end(),
+        std::make_pair(value, mrb_sym(0)));
+    if(it == m_by_value.end() || it->first != value) return 0;
+    return it->second;
+  }
+
+  /// Checks that a value is an enumerator or, for flags, a combination of them
+  bool valid(int64_t value) const {
+    if(m_flags) return (value & ~m_mask) == 0;
+    return find(value) != 0;
+  }
+
+  /// Converts a Symbol, an Integer or, for flags, an Array of them
+  bool convert(mrb_state* mrb, mrb_value val, int64_t& value) const {
+    if(mrb_symbol_p(val)) return find(mrb_symbol(val), value);
+    if(mrb_fixnum_p(val)) {
+      value = mrb_fixnum(val);
+      return valid(value);
+    }
+    if(m_flags && mrb_array_p(val)) {
+      value = 0;
+      for(mrb_int i = 0; i < RARRAY_LEN(val); i++) {
+        int64_t v;
+        if(!convert(mrb, RARRAY_PTR(val)[i], v)) return false;
+        value |= v;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  private:
+
+  std::vector<std::pair<mrb_sym, int64_t>> m_by_symbol;
+  std::vector<std::pair<int64_t, mrb_sym>> m_by_value;
+  int64_t m_mask  = 0;
+  bool    m_flags = false;
+};
+
+inline size_t next_enum_index() {
+  static std::atomic<size_t> counter(0);
+  return counter++;
+}
+
+/// Index of the table of enum E in state_data::enums
+template<typename E>
+size_t enum_index() {
+  static const size_t index = next_enum_index();
+  return index;
+}
+
+/// Returns the table of enum E in the given state, or nullptr if E
+/// has not been bound with module::def_enum
+template<typename E>
+const enum_table* find_enum_table(mrb_state* mrb) {
+  const auto& enums = get_state_data(mrb).enums;
+  size_t index = enum_index<E>();
+  return index < enums.size() ? enums[index].get() : nullptr;
+}
+
+template<typename E>
+void set_enum_table(mrb_state* mrb, std::unique_ptr<enum_table> table) {
+  auto& enums = get_state_data(mrb).enums;
+  size_t index = enum_index<E>();
+  if(index >= enums.size()) enums.resize(index + 1);
+  enums[index] = std::move(table);
+}
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
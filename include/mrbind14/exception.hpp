@@ -4,6 +4,7 @@
 #include <mrbind14/object.hpp>
 #include <mruby.h>
 #include <exception>
+#include <stdexcept>
 
 namespace mrbind14 {
 
@@ -11,11 +12,15 @@ class exception : public object, public std::exception {
 
   public:
 
-  static void translate_and_throw_exception(mrb_state* mrb, mrb_value exc) {
-    throw std::runtime_error("MRuby exception occured");
-  }
+  static void translate_and_throw_exception(mrb_state* mrb, mrb_value exc);
 };
 
+#if MRBIND14_DEFINITIONS
+MRBIND14_INLINE void exception::translate_and_throw_exception(mrb_state* mrb, mrb_value exc) {
+  throw std::runtime_error("MRuby exception occured");
+}
+#endif
+
 }
 
 #endif
@@ -0,0 +1,208 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_GC_H_
+#define MRBIND14_GC_H_
+
+#include <mrbind14/config.hpp>
+#include <mruby.h>
+#include <mruby/gc.h>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace mrbind14 {
+
+/**
+ * @brief Snapshot of the garbage collector of an interpreter.
+ */
+struct gc_stats {
+  uint64_t collections    = 0;     // collections completed through the interpreter's GC API
+  size_t   live_objects   = 0;     // number of live objects
+  size_t   heap_pages     = 0;     // number of allocated heap pages
+  size_t   threshold      = 0;     // live object count triggering the next GC step
+  int      arena_index    = 0;     // current position in the GC arena
+  int      arena_capacity = 0;     // current capacity of the GC arena
+  bool     generational   = false; // whether generational mode is enabled
+};
+
+/**
+ * @brief Garbage collection modes supported by MRuby.
+ */
+enum class gc_mode {
+  incremental,
+  generational
+};
+
+/**
+ * @brief Pause times of the collections run through the interpreter's
+ * GC API. All durations are in nanoseconds; percentiles are upper
+ * bounds taken from a power-of-two histogram.
+ */
+struct gc_pause_stats {
+  uint64_t count    = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns   = 0;
+  uint64_t p50_ns   = 0;
+  uint64_t p99_ns   = 0;
+};
+
+/**
+ * @brief The gc_arena_scope class saves the GC arena index of an
+ * MRuby state when constructed and restores it when destroyed, so
+ * that the objects created within its lifetime stop being protected
+ * from the garbage collector (unless they are referenced elsewhere).
+ * Use it around C++ loops that create many Ruby objects.
+ */
+class gc_arena_scope {
+
+  public:
+
+  explicit gc_arena_scope(mrb_state* mrb)
+  : m_mrb(mrb)
+  , m_index(mrb_gc_arena_save(mrb)) {}
+
+  gc_arena_scope(const gc_arena_scope&) = delete;
+
+  gc_arena_scope& operator=(const gc_arena_scope&) = delete;
+
+  ~gc_arena_scope() {
+    if(m_mrb) mrb_gc_arena_restore(m_mrb, m_index);
+  }
+
+  /**
+   * @brief Restores the arena, then protects the provided value so
+   * that it outlives the scope. The destructor then does nothing.
+   *
+   * @param val Value to keep.
+   *
+   * @return The value.
+   */
+  mrb_value escape(mrb_value val) {
+    mrb_gc_arena_restore(m_mrb, m_index);
+    mrb_gc_protect(m_mrb, val);
+    m_mrb = nullptr;
+    return val;
+  }
+
+  private:
+
+  mrb_state* m_mrb;
+  int        m_index;
+};
+
+/**
+ * @brief The gc_pause_scope class disables the garbage collector of
+ * an MRuby state for its lifetime, so that no GC step happens in a
+ * critical section. Objects allocated meanwhile still count towards
+ * the next GC step.
+ */
+class gc_pause_scope {
+
+  public:
+
+  explicit gc_pause_scope(mrb_state* mrb)
+  : m_mrb(mrb)
+  , m_was_disabled(mrb->gc.disabled) {
+    m_mrb->gc.disabled = TRUE;
+  }
+
+  gc_pause_scope(const gc_pause_scope&) = delete;
+
+  gc_pause_scope& operator=(const gc_pause_scope&) = delete;
+
+  ~gc_pause_scope() {
+    m_mrb->gc.disabled = m_was_disabled;
+  }
+
+  private:
+
+  mrb_state* m_mrb;
+  bool       m_was_disabled;
+};
+
+namespace detail {
+
+/// Records GC pause times in 64 power-of-two buckets, which is enough
+/// to answer percentile queries without keeping every sample.
+class gc_pause_histogram {
+
+  public:
+
+  void record(std::chrono::steady_clock::duration d) {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    m_count    += 1;
+    m_total_ns += ns;
+    if(ns > m_max_ns) m_max_ns = ns;
+    unsigned bucket = 0;
+    while(bucket < 63 && (uint64_t(1) << bucket) < ns) bucket++;
+    m_buckets[bucket] += 1;
+  }
+
+  gc_pause_stats stats() const {
+    gc_pause_stats s;
+    s.count    = m_count;
+    s.total_ns = m_total_ns;
+    s.max_ns   = m_max_ns;
+    s.p50_ns   = percentile(0.50);
+    s.p99_ns   = percentile(0.99);
+    return s;
+  }
+
+  void reset() {
+    *this = gc_pause_histogram();
+  }
+
+  private:
+
+  uint64_t percentile(double q) const {
+    if(m_count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * m_count);
+    uint64_t seen = 0;
+    for(unsigned b = 0; b < 64; b++) {
+      seen += m_buckets[b];
+      if(seen > rank) {
+        uint64_t bound = uint64_t(1) << b;
+        return bound < m_max_ns ? bound : m_max_ns;
+      }
+    }
+    return m_max_ns;
+  }
+
+  uint64_t m_count       = 0;
+  uint64_t m_total_ns    = 0;
+  uint64_t m_max_ns      = 0;
+  uint64_t m_buckets[64] = {};
+};
+
+/// Collects statistics from the mrb_state's garbage collector
+MRBIND14_INLINE gc_stats collect_gc_stats(mrb_state* mrb);
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE gc_stats collect_gc_stats(mrb_state* mrb) {
+  gc_stats stats;
+  const mrb_gc& gc     = mrb->gc;
+  stats.live_objects   = gc.live;
+  stats.threshold      = gc.threshold;
+  stats.arena_index    = gc.arena_idx;
+#ifdef MRB_GC_FIXED_ARENA
+  stats.arena_capacity = MRB_GC_ARENA_SIZE;
+#else
+  stats.arena_capacity = gc.arena_capa;
+#endif
+  stats.generational   = gc.generational;
+  for(auto page = gc.heaps; page; page = page->next)
+    stats.heap_pages += 1;
+  return stats;
+}
+
+#endif
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
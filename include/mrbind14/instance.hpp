@@ -0,0 +1,166 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_INSTANCE_H_
+#define MRBIND14_INSTANCE_H_
+
+#include <mrbind14/state.hpp>
+#include <mrbind14/type_registry.hpp>
+#include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/variable.h>
+#include <memory>
+#include <stdexcept>
+#include <typeinfo>
+
+namespace mrbind14 {
+
+/**
+ * @brief Annotation controlling how a bound function returning an
+ * instance of a bound class (by value, reference or pointer) hands
+ * it to Ruby:
+ *
+ * - automatic: move values, copy references, refer to pointers without
+ *   owning them (as with reference)
+ * - copy: the Ruby object owns a copy of the result
+ * - move: the Ruby object owns an object move-constructed from the result
+ * - reference: the Ruby object refers to the result without owning it;
+ *   the C++ object must outlive it
+ * - reference_internal: like reference, and the receiver of the call
+ *   is kept alive as long as the returned object
+ * - take_ownership: the Ruby object owns the returned pointer
+ *
+ *   cls.def_method("table", &Registry::table, return_value_policy::reference_internal);
+ */
+enum class return_value_policy {
+  automatic,
+  copy,
+  move,
+  reference,
+  reference_internal,
+  take_ownership
+};
+
+namespace detail {
+
+/// C++ object held by a Ruby object of a bound class
+struct instance {
+  void*                 value;  // pointer to the C++ object
+  std::shared_ptr<void> holder; // owns the object, if the Ruby object does
+  struct RData*         object; // Ruby object wrapping value
+};
+
+/// Called by the GC when the Ruby object is freed: removes the object
+/// from the identity map of the state and releases the holder
+MRBIND14_INLINE void free_instance(mrb_state* mrb, void* p);
+
+/// Returns the mrb_data_type of Ruby objects wrapping a T. Its address
+/// is unique per type, so checking that a Ruby object wraps a T is a
+/// single pointer comparison.
+template<typename T>
+const mrb_data_type* data_type() {
+  static const mrb_data_type type = { typeid(T).name(), &free_instance };
+  return &type;
+}
+
+/// Returns a pointer to the T wrapped by val, or nullptr if val
+/// is not an initialized object of a class bound to T.
+template<typename T>
+T* get_instance_ptr(mrb_value val) {
+  if(mrb_type(val) != MRB_TT_DATA || DATA_TYPE(val) != data_type<T>())
+    return nullptr;
+  return static_cast<T*>(static_cast<instance*>(DATA_PTR(val))->value);
+}
+
+/// Returns the Ruby class bound to T in the given state
+template<typename T>
+struct RClass* find_class(mrb_state* mrb) {
+  const auto& classes = get_state_data(mrb).classes;
+  auto it = classes.find(typeid(T));
+  if(it == classes.end())
+    throw std::runtime_error("C++ type " + demangle<T>() + " is not bound to a Ruby class");
+  return it->second;
+}
+
+/// Registers a Ruby object in the identity map of the state
+MRBIND14_INLINE void register_instance(mrb_state* mrb, instance* inst, struct RData* object);
+
+/// Creates a Ruby object wrapping ptr. The holder, if any, is released
+/// when the Ruby object is garbage collected.
+template<typename T>
+mrb_value wrap_instance(mrb_state* mrb, T* ptr, std::shared_ptr<void> holder) {
+  struct RClass* cls = find_class<T>(mrb);
+  auto inst = new instance{ ptr, std::move(holder), nullptr };
+  struct RData* object = mrb_data_object_alloc(mrb, cls, inst, data_type<T>());
+  register_instance(mrb, inst, object);
+  return mrb_obj_value(object);
+}
+
+/// Returns the live Ruby object already wrapping ptr as a T, or nil
+template<typename T>
+mrb_value find_instance(mrb_state* mrb, T* ptr) {
+  const auto& instances = get_state_data(mrb).instances;
+  auto it = instances.find(ptr);
+  if(it == instances.end()
+  || it->second->type != data_type<T>()
+  || mrb_object_dead_p(mrb, reinterpret_cast<struct RBasic*>(it->second)))
+    return mrb_nil_value();
+  return mrb_obj_value(it->second);
+}
+
+/// Returns the Ruby object already wrapping ptr if any, so that the
+/// same C++ object is always seen as the same Ruby object, or wraps it
+/// as wrap_instance does
+template<typename T>
+mrb_value find_or_wrap_instance(mrb_state* mrb, T* ptr, std::shared_ptr<void> holder) {
+  mrb_value obj = find_instance(mrb, ptr);
+  if(!mrb_nil_p(obj)) return obj;
+  return wrap_instance(mrb, ptr, std::move(holder));
+}
+
+/// Creates a Ruby object referring to ptr without owning it. With
+/// reference_internal, parent is kept alive by the new object.
+template<typename T>
+mrb_value wrap_reference(mrb_state* mrb, T* ptr, return_value_policy policy, mrb_value parent) {
+  mrb_value obj = find_or_wrap_instance(mrb, ptr, nullptr);
+  if(policy == return_value_policy::reference_internal)
+    mrb_iv_set(mrb, obj, mrb_intern_lit(mrb, "__parent__"), parent);
+  return obj;
+}
+
+/// Makes an allocated Ruby object (e.g. in its initialize method) own obj
+template<typename T>
+void initialize_instance(mrb_state* mrb, mrb_value self, std::shared_ptr<T> obj) {
+  if(DATA_PTR(self)) free_instance(mrb, DATA_PTR(self));
+  auto ptr  = obj.get();
+  auto inst = new instance{ ptr, std::move(obj), nullptr };
+  mrb_data_init(self, inst, data_type<T>());
+  register_instance(mrb, inst, RDATA(self));
+}
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE void free_instance(mrb_state* mrb, void* p) {
+  auto inst = static_cast<instance*>(p);
+  auto& instances = get_state_data(mrb).instances;
+  auto it = instances.find(inst->value);
+  if(it != instances.end() && it->second == inst->object)
+    instances.erase(it);
+  delete inst;
+}
+
+MRBIND14_INLINE void register_instance(mrb_state* mrb, instance* inst, struct RData* object) {
+  inst->object = object;
+  get_state_data(mrb).instances[inst->value] = object;
+}
+
+#endif
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
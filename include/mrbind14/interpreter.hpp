@@ -8,12 +8,29 @@
 
 #include <mrbind14/object.hpp>
 #include <mrbind14/module.hpp>
+#include <mrbind14/class.hpp>
+#include <mrbind14/shared_table.hpp>
+#include <mrbind14/vectorize.hpp>
+#include <mrbind14/json.hpp>
 #include <mrbind14/exception.hpp>
+#include <mrbind14/profiler.hpp>
+#include <mrbind14/gc.hpp>
+#include <mrbind14/state.hpp>
+#include <mrbind14/mapped_file.hpp>
 #include <mruby.h>
 #include <mruby/compile.h>
 #include <mruby/variable.h>
 #include <string>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
 #include <exception>
+#include <stdexcept>
+#include <cstring>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace mrbind14 {
 
@@ -55,8 +72,9 @@ class interpreter : public module {
    */
   interpreter& operator=(interpreter&& other) {
     if(m_mrb == other.m_mrb) return *this;
-    if(m_mrb) mrb_close(m_mrb);
+    if(m_mrb) detail::close_state(m_mrb);
     m_mrb = other.m_mrb;
+    m_module = other.m_module;
     other.m_mrb = nullptr;
     return *this;
   }
@@ -66,7 +84,7 @@ class interpreter : public module {
    * and free up its resources.
    */
   ~interpreter() {
-    if(m_mrb) mrb_close(m_mrb);
+    if(m_mrb) detail::close_state(m_mrb);
   }
 
   /**
@@ -79,6 +97,7 @@ class interpreter : public module {
   template<typename ValueType>
   void set_global(const char* name, const ValueType& val) {
     mrb_sym sym = mrb_intern_static(m_mrb, name, strlen(name));
+    gc_arena_scope arena(m_mrb);
     mrb_gv_set(m_mrb, sym, detail::cpp_to_mrb(m_mrb, val));
   }
 
@@ -104,13 +123,316 @@ class interpreter : public module {
    * @return The value returned by the Ruby script.
    */
   object execute(const char* script) {
-    auto val = mrb_load_string(m_mrb, script);
+    return execute(script, strlen(script));
+  }
+
+  /**
+   * @brief Executes the given Ruby script, which does not need to be
+   * null-terminated.
+   *
+   * @param script Ruby script.
+   * @param size Size of the script in bytes.
+   * @param filename Name reported in error locations (optional).
+   *
+   * @return The value returned by the Ruby script.
+   */
+  object execute(const char* script, size_t size, const char* filename = nullptr) {
+    mrbc_context* cxt = compile_context(filename);
+    auto val = mrb_load_nstring_cxt(m_mrb, script, size, cxt);
     if(m_mrb->exc) {
       exception::translate_and_throw_exception(m_mrb, mrb_obj_value(m_mrb->exc));
     }
     return object(m_mrb, val);
   }
 
+#if __cplusplus >= 201703L
+  /**
+   * @brief Executes the given Ruby script.
+   *
+   * @param script Ruby script.
+   * @param filename Name reported in error locations (optional).
+   *
+   * @return The value returned by the Ruby script.
+   */
+  object execute(std::string_view script, const char* filename = nullptr) {
+    return execute(script.data(), script.size(), filename);
+  }
+#endif
+
+  /**
+   * @brief Executes the Ruby script contained in a file. On POSIX
+   * systems the file is memory-mapped rather than read into a buffer
+   * (see MRBIND14_USE_MMAP). Its path is reported in error locations.
+   *
+   * @param path Path to the file.
+   *
+   * @return The value returned by the Ruby script.
+   */
+  object execute_file(const std::string& path) {
+    detail::mapped_file file(path);
+    return execute(file.data(), file.size(), path.c_str());
+  }
+
+  /**
+   * @brief Writes the name and signature of all the functions bound
+   * in this interpreter, one per line (e.g. "add(int, int) -> int").
+   */
+  void write_signatures(std::ostream& os) const {
+    for(const auto& f : detail::get_state_data(m_mrb).functions)
+      os << f->name() << f->signature(m_mrb) << '\n';
+  }
+
+  /**
+   * @brief Returns the cache counters of the functions bound in this
+   * interpreter with a memoize (or pure) annotation.
+   */
+  std::vector<memo_stats> memoize_stats() const {
+    std::vector<memo_stats> result;
+    for(const auto& f : detail::get_state_data(m_mrb).functions)
+      if(f->memoized()) result.push_back(f->memoize_stats());
+    return result;
+  }
+
+  /**
+   * @brief Empties the caches of the memoized functions and resets their
+   * counters, e.g. after the data they depend on has changed.
+   */
+  void clear_memoized() {
+    for(auto& f : detail::get_state_data(m_mrb).functions)
+      f->clear_memoized(m_mrb);
+  }
+
+#if MRBIND14_ENABLE_PROFILING
+  /**
+   * @brief Returns the profiling information collected for
+   * all the functions bound in this interpreter.
+   */
+  std::vector<function_profile> function_profiles() const {
+    std::vector<function_profile> result;
+    for(const auto& f : detail::get_state_data(m_mrb).functions)
+      result.push_back(f->profile());
+    return result;
+  }
+
+  /**
+   * @brief Resets the profiling counters of all the bound functions.
+   */
+  void reset_function_profiles() {
+    for(auto& f : detail::get_state_data(m_mrb).functions)
+      f->reset_profile();
+  }
+
+  /**
+   * @brief Writes the function profiles as a text table.
+   */
+  void write_profile_table(std::ostream& os) const {
+    detail::write_profile_table(os, function_profiles());
+  }
+
+  /**
+   * @brief Writes the function profiles as a JSON array.
+   */
+  void write_profile_json(std::ostream& os) const {
+    detail::write_profile_json(os, function_profiles());
+  }
+#endif
+
+#ifdef MRB_ENABLE_DEBUG_HOOK
+  /**
+   * @brief Starts sampling the Ruby code executed by this interpreter.
+   * Requires mruby to be built with MRB_ENABLE_DEBUG_HOOK.
+   *
+   * @param interval Number of VM instructions between two samples.
+   */
+  void start_script_profiling(unsigned interval = 1000) {
+    detail::get_state_data(m_mrb).sampler.start(m_mrb, interval);
+  }
+
+  /**
+   * @brief Stops sampling the Ruby code. Collected samples are kept.
+   */
+  void stop_script_profiling() {
+    detail::get_state_data(m_mrb).sampler.stop(m_mrb);
+  }
+#endif
+
+  /**
+   * @brief Returns the samples collected by the script profiler,
+   * as a map from folded stack to number of samples.
+   */
+  const std::unordered_map<std::string, uint64_t>& script_profile() const {
+    return detail::get_state_data(m_mrb).sampler.folded_stacks();
+  }
+
+  /**
+   * @brief Writes the samples collected by the script profiler in
+   * the folded format used by flamegraph tools.
+   */
+  void write_script_profile(std::ostream& os) const {
+    detail::get_state_data(m_mrb).sampler.write_folded(os);
+  }
+
+  /**
+   * @brief Clears the samples collected by the script profiler.
+   */
+  void reset_script_profile() {
+    detail::get_state_data(m_mrb).sampler.reset();
+  }
+
+  /**
+   * @brief Returns statistics about the garbage collector.
+   */
+  gc_stats get_gc_stats() const {
+    auto stats = detail::collect_gc_stats(m_mrb);
+    stats.collections = detail::get_state_data(m_mrb).gc_collections;
+    return stats;
+  }
+
+  /**
+   * @brief Runs a full garbage collection.
+   */
+  void full_gc() {
+    auto& data = detail::get_state_data(m_mrb);
+    auto start = std::chrono::steady_clock::now();
+    mrb_full_gc(m_mrb);
+    data.gc_pauses.record(std::chrono::steady_clock::now() - start);
+    data.gc_collections += 1;
+  }
+
+  /**
+   * @brief Runs incremental GC steps until the current collection
+   * cycle completes or the time budget is exhausted. Each step does
+   * an amount of work controlled by the step ratio.
+   *
+   * @param budget Maximum time to spend collecting.
+   *
+   * @return true if a collection cycle completed.
+   */
+  bool incremental_step(std::chrono::microseconds budget) {
+    auto& gc = m_mrb->gc;
+    if(gc.disabled || gc.iterating) return false;
+    auto& data     = detail::get_state_data(m_mrb);
+    auto start     = std::chrono::steady_clock::now();
+    auto deadline  = start + budget;
+    bool completed = false;
+    do {
+      mrb_incremental_gc(m_mrb);
+      completed = (gc.state == MRB_GC_STATE_ROOT);
+    } while(!completed && std::chrono::steady_clock::now() < deadline);
+    data.gc_pauses.record(std::chrono::steady_clock::now() - start);
+    if(completed) data.gc_collections += 1;
+    return completed;
+  }
+
+  /**
+   * @brief Helper for pooled interpreters, to be called between two
+   * requests: if a collection is in progress or due, it is advanced
+   * within the given budget, so that it is less likely to happen in
+   * the middle of the next request.
+   *
+   * @param budget Maximum time to spend collecting.
+   *
+   * @return true if the GC has no pending work left.
+   */
+  bool gc_between_requests(std::chrono::microseconds budget) {
+    const auto& gc = m_mrb->gc;
+    if(gc.state == MRB_GC_STATE_ROOT && gc.live < gc.threshold) return true;
+    return incremental_step(budget);
+  }
+
+  /**
+   * @brief Switches the garbage collector between incremental
+   * and generational modes.
+   */
+  void set_gc_mode(gc_mode mode) {
+    bool generational = (mode == gc_mode::generational);
+    if(m_mrb->gc.generational == generational) return;
+    if(m_mrb->gc.disabled || m_mrb->gc.iterating)
+      throw std::runtime_error("Cannot change GC mode while the GC is disabled or iterating");
+    mrb_value gc_module = mrb_obj_value(mrb_module_get(m_mrb, "GC"));
+    mrb_funcall(m_mrb, gc_module, "generational_mode=", 1, mrb_bool_value(generational));
+  }
+
+  /**
+   * @brief Returns the current garbage collection mode.
+   */
+  gc_mode get_gc_mode() const {
+    return m_mrb->gc.generational ? gc_mode::generational : gc_mode::incremental;
+  }
+
+  /**
+   * @brief Sets the step ratio, i.e. the amount of work done by each
+   * incremental GC step, as a percentage (MRuby's default is 200).
+   */
+  void set_gc_step_ratio(int ratio) {
+    m_mrb->gc.step_ratio = ratio;
+  }
+
+  /**
+   * @brief Returns the step ratio.
+   */
+  int get_gc_step_ratio() const {
+    return m_mrb->gc.step_ratio;
+  }
+
+  /**
+   * @brief Sets the interval ratio, i.e. how much the number of live
+   * objects may grow, as a percentage of the number of objects left
+   * after the last collection, before a new collection cycle starts
+   * (MRuby's default is 200).
+   */
+  void set_gc_interval_ratio(int ratio) {
+    m_mrb->gc.interval_ratio = ratio;
+  }
+
+  /**
+   * @brief Returns the interval ratio.
+   */
+  int get_gc_interval_ratio() const {
+    return m_mrb->gc.interval_ratio;
+  }
+
+  /**
+   * @brief Returns the pause times of the collections run through
+   * full_gc, incremental_step and gc_between_requests.
+   */
+  gc_pause_stats get_gc_pause_stats() const {
+    return detail::get_state_data(m_mrb).gc_pauses.stats();
+  }
+
+  /**
+   * @brief Resets the pause time statistics.
+   */
+  void reset_gc_pause_stats() {
+    detail::get_state_data(m_mrb).gc_pauses.reset();
+  }
+
+  private:
+
+  /// Returns the compile context of the interpreter, created on first
+  /// use and reused across loads, with its filename set to filename.
+  /// The parser records the local variables of each script in the
+  /// context, and loading turns keep_lv on, so both are reset for
+  /// scripts to stay independent (see session for the opposite).
+  mrbc_context* compile_context(const char* filename) {
+    auto& cxt = detail::get_state_data(m_mrb).compile_context;
+    if(!cxt) cxt = mrbc_context_new(m_mrb);
+    if(cxt->syms) {
+      mrb_free(m_mrb, cxt->syms);
+      cxt->syms = nullptr;
+      cxt->slen = 0;
+    }
+    cxt->keep_lv = FALSE;
+    if(filename) {
+      mrbc_filename(m_mrb, cxt, filename);
+    } else if(cxt->filename) {
+      mrb_free(m_mrb, cxt->filename);
+      cxt->filename = nullptr;
+    }
+    cxt->lineno = 1;
+    return cxt;
+  }
+
 };
 
 }
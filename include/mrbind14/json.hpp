@@ -0,0 +1,512 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_JSON_H_
+#define MRBIND14_JSON_H_
+
+#include <mrbind14/module.hpp>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace mrbind14 {
+
+#if MRBIND14_DEFINITIONS
+
+namespace detail {
+
+/// Same default as Ruby's JSON: deeper documents are rejected
+constexpr int json_max_nesting = 100;
+
+/// Returns the first character in [p, end) that is a double quote, a
+/// backslash or a control character, i.e. one that ends a plain run of
+/// a JSON string, or end if there is none. Checks 16 bytes at a time
+/// with SSE2 when available.
+MRBIND14_INLINE const char* json_find_special(const char* p, const char* end) {
+#if defined(__SSE2__)
+  const __m128i quote     = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control   = _mm_set1_epi8(0x1f);
+  while(end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control)); // chunk <= 0x1f
+    int mask = _mm_movemask_epi8(special);
+    if(mask) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#endif
+  while(p < end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20) ++p;
+  return p;
+}
+
+/// Parser building mrb_values directly from the input, without any
+/// intermediate representation. Strings without escapes are created
+/// with a single copy from the input.
+class json_parser {
+
+  public:
+
+  json_parser(mrb_state* mrb, struct RClass* error, const char* data, size_t size)
+  : m_mrb(mrb)
+  , m_error(error)
+  , m_begin(data)
+  , m_pos(data)
+  , m_end(data + size) {}
+
+  mrb_value parse() {
+    skip_whitespace();
+    mrb_value val = parse_value(0);
+    skip_whitespace();
+    if(m_pos != m_end) fail("unexpected token");
+    return val;
+  }
+
+  private:
+
+  [[noreturn]] void fail(const char* msg) {
+    mrb_raisef(m_mrb, m_error, "%S at offset %S",
+        mrb_str_new_cstr(m_mrb, msg), mrb_fixnum_value(m_pos - m_begin));
+  }
+
+  void skip_whitespace() {
+    while(m_pos < m_end && (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t'))
+      ++m_pos;
+  }
+
+  void expect(const char* literal, size_t len) {
+    if(static_cast<size_t>(m_end - m_pos) < len || std::memcmp(m_pos, literal, len) != 0)
+      fail("unexpected token");
+    m_pos += len;
+  }
+
+  static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  mrb_value parse_value(int depth) {
+    if(m_pos == m_end) fail("unexpected end of input");
+    switch(*m_pos) {
+    case '{': return parse_object(depth);
+    case '[': return parse_array(depth);
+    case '"': return parse_string();
+    case 't': expect("true", 4);  return mrb_true_value();
+    case 'f': expect("false", 5); return mrb_false_value();
+    case 'n': expect("null", 4);  return mrb_nil_value();
+    default:
+      if(*m_pos == '-' || is_digit(*m_pos)) return parse_number();
+      fail("unexpected token");
+    }
+  }
+
+  // Elements are protected by their container, hence the GC arena is
+  // reset after each of them.
+
+  mrb_value parse_array(int depth) {
+    if(depth >= json_max_nesting) fail("nesting too deep");
+    ++m_pos;
+    mrb_value ary = mrb_ary_new(m_mrb);
+    int ai = mrb_gc_arena_save(m_mrb);
+    skip_whitespace();
+    if(m_pos < m_end && *m_pos == ']') {
+      ++m_pos;
+      return ary;
+    }
+    for(;;) {
+      skip_whitespace();
+      mrb_ary_push(m_mrb, ary, parse_value(depth + 1));
+      mrb_gc_arena_restore(m_mrb, ai);
+      skip_whitespace();
+      if(m_pos == m_end) fail("unexpected end of input");
+      char c = *m_pos++;
+      if(c == ']') return ary;
+      if(c != ',') fail("expected ',' or ']'");
+    }
+  }
+
+  mrb_value parse_object(int depth) {
+    if(depth >= json_max_nesting) fail("nesting too deep");
+    ++m_pos;
+    mrb_value hash = mrb_hash_new(m_mrb);
+    int ai = mrb_gc_arena_save(m_mrb);
+    skip_whitespace();
+    if(m_pos < m_end && *m_pos == '}') {
+      ++m_pos;
+      return hash;
+    }
+    for(;;) {
+      skip_whitespace();
+      if(m_pos == m_end || *m_pos != '"') fail("expected string key");
+      mrb_value key = parse_string();
+      skip_whitespace();
+      if(m_pos == m_end || *m_pos != ':') fail("expected ':'");
+      ++m_pos;
+      skip_whitespace();
+      mrb_value val = parse_value(depth + 1);
+      mrb_hash_set(m_mrb, hash, key, val);
+      mrb_gc_arena_restore(m_mrb, ai);
+      skip_whitespace();
+      if(m_pos == m_end) fail("unexpected end of input");
+      char c = *m_pos++;
+      if(c == '}') return hash;
+      if(c != ',') fail("expected ',' or '}'");
+    }
+  }
+
+  mrb_value parse_string() {
+    const char* start = ++m_pos;
+    m_pos = json_find_special(m_pos, m_end);
+    if(m_pos < m_end && *m_pos == '"') {
+      return mrb_str_new(m_mrb, start, (m_pos++) - start);
+    }
+    mrb_value str = mrb_str_new(m_mrb, start, m_pos - start);
+    for(;;) {
+      if(m_pos == m_end) fail("unterminated string");
+      char c = *m_pos;
+      if(c == '"') {
+        ++m_pos;
+        return str;
+      }
+      if(c != '\\') fail("control character in string");
+      parse_escape(str);
+      start = m_pos;
+      m_pos = json_find_special(m_pos, m_end);
+      mrb_str_cat(m_mrb, str, start, m_pos - start);
+    }
+  }
+
+  void parse_escape(mrb_value str) {
+    if(m_end - m_pos < 2) fail("unterminated string");
+    char c = m_pos[1];
+    m_pos += 2;
+    const char* replacement = nullptr;
+    switch(c) {
+    case '"':  replacement = "\""; break;
+    case '\\': replacement = "\\"; break;
+    case '/':  replacement = "/";  break;
+    case 'b':  replacement = "\b"; break;
+    case 'f':  replacement = "\f"; break;
+    case 'n':  replacement = "\n"; break;
+    case 'r':  replacement = "\r"; break;
+    case 't':  replacement = "\t"; break;
+    case 'u':  break;
+    default:   fail("invalid escape");
+    }
+    if(replacement) {
+      mrb_str_cat(m_mrb, str, replacement, 1);
+      return;
+    }
+    uint32_t cp = parse_hex4();
+    if(cp >= 0xd800 && cp <= 0xdbff) {
+      // high surrogate, must be followed by a low one
+      if(m_end - m_pos < 2 || m_pos[0] != '\\' || m_pos[1] != 'u') fail("invalid surrogate pair");
+      m_pos += 2;
+      uint32_t low = parse_hex4();
+      if(low < 0xdc00 || low > 0xdfff) fail("invalid surrogate pair");
+      cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+    } else if(cp >= 0xdc00 && cp <= 0xdfff) {
+      fail("invalid surrogate pair");
+    }
+    char buf[4];
+    size_t len;
+    if(cp < 0x80) {
+      buf[0] = static_cast<char>(cp);
+      len = 1;
+    } else if(cp < 0x800) {
+      buf[0] = static_cast<char>(0xc0 | (cp >> 6));
+      buf[1] = static_cast<char>(0x80 | (cp & 0x3f));
+      len = 2;
+    } else if(cp < 0x10000) {
+      buf[0] = static_cast<char>(0xe0 | (cp >> 12));
+      buf[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+      buf[2] = static_cast<char>(0x80 | (cp & 0x3f));
+      len = 3;
+    } else {
+      buf[0] = static_cast<char>(0xf0 | (cp >> 18));
+      buf[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+      buf[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+      buf[3] = static_cast<char>(0x80 | (cp & 0x3f));
+      len = 4;
+    }
+    mrb_str_cat(m_mrb, str, buf, len);
+  }
+
+  uint32_t parse_hex4() {
+    if(m_end - m_pos < 4) fail("invalid unicode escape");
+    uint32_t cp = 0;
+    for(int i = 0; i < 4; i++) {
+      char c = *m_pos++;
+      cp <<= 4;
+      if(c >= '0' && c <= '9')      cp |= c - '0';
+      else if(c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+      else if(c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+      else fail("invalid unicode escape");
+    }
+    return cp;
+  }
+
+  mrb_value parse_number() {
+    const char* start = m_pos;
+    if(*m_pos == '-') ++m_pos;
+    if(m_pos == m_end || !is_digit(*m_pos)) fail("invalid number");
+    if(*m_pos == '0') ++m_pos;
+    else while(m_pos < m_end && is_digit(*m_pos)) ++m_pos;
+    bool integer = true;
+    if(m_pos < m_end && *m_pos == '.') {
+      integer = false;
+      ++m_pos;
+      if(m_pos == m_end || !is_digit(*m_pos)) fail("invalid number");
+      while(m_pos < m_end && is_digit(*m_pos)) ++m_pos;
+    }
+    if(m_pos < m_end && (*m_pos == 'e' || *m_pos == 'E')) {
+      integer = false;
+      ++m_pos;
+      if(m_pos < m_end && (*m_pos == '+' || *m_pos == '-')) ++m_pos;
+      if(m_pos == m_end || !is_digit(*m_pos)) fail("invalid number");
+      while(m_pos < m_end && is_digit(*m_pos)) ++m_pos;
+    }
+    size_t len = m_pos - start;
+    // integers are parsed exactly as long as they fit in an mrb_int
+    if(integer) {
+      bool negative  = *start == '-';
+      uint64_t limit = negative ? uint64_t(MRB_INT_MAX) + 1 : uint64_t(MRB_INT_MAX);
+      uint64_t v     = 0;
+      const char* p  = start + negative;
+      for(; p < m_pos; p++) {
+        unsigned d = *p - '0';
+        if(v > (limit - d) / 10) break;
+        v = v * 10 + d;
+      }
+      // -(v - 1) - 1 negates v without overflowing for MRB_INT_MIN
+      if(p == m_pos)
+        return mrb_fixnum_value(negative && v ? -static_cast<mrb_int>(v - 1) - 1 : static_cast<mrb_int>(v));
+    }
+    // strtod needs a null-terminated string
+    char buf[64];
+    std::string long_number;
+    const char* str = buf;
+    if(len < sizeof(buf)) {
+      std::memcpy(buf, start, len);
+      buf[len] = '\0';
+    } else {
+      long_number.assign(start, len);
+      str = long_number.c_str();
+    }
+    return mrb_float_value(m_mrb, std::strtod(str, nullptr));
+  }
+
+  mrb_state*     m_mrb;
+  struct RClass* m_error;
+  const char*    m_begin;
+  const char*    m_pos;
+  const char*    m_end;
+};
+
+/// Emitter writing JSON directly into a growable Ruby string. Values
+/// other than nil, booleans, numbers, strings, symbols, arrays and
+/// hashes are written as the string returned by their to_s method.
+class json_emitter {
+
+  public:
+
+  json_emitter(mrb_state* mrb, struct RClass* error)
+  : m_mrb(mrb)
+  , m_error(error)
+  , m_out(mrb_str_buf_new(mrb, 256)) {}
+
+  mrb_value result() const {
+    return m_out;
+  }
+
+  void emit(mrb_value val, int depth = 0) {
+    switch(mrb_type(val)) {
+    case MRB_TT_FALSE:
+      if(mrb_nil_p(val)) append("null", 4);
+      else append("false", 5);
+      break;
+    case MRB_TT_TRUE:
+      append("true", 4);
+      break;
+    case MRB_TT_FIXNUM:
+      emit_integer(mrb_fixnum(val));
+      break;
+    case MRB_TT_FLOAT:
+      emit_float(mrb_float(val));
+      break;
+    case MRB_TT_STRING:
+      emit_string(RSTRING_PTR(val), RSTRING_LEN(val));
+      break;
+    case MRB_TT_SYMBOL: {
+      mrb_int len;
+      const char* name = mrb_sym2name_len(m_mrb, mrb_symbol(val), &len);
+      emit_string(name, len);
+      break;
+    }
+    case MRB_TT_ARRAY: {
+      if(depth >= json_max_nesting) too_deep();
+      append("[", 1);
+      for(mrb_int i = 0; i < RARRAY_LEN(val); i++) {
+        if(i != 0) append(",", 1);
+        emit(RARRAY_PTR(val)[i], depth + 1);
+      }
+      append("]", 1);
+      break;
+    }
+    case MRB_TT_HASH: {
+      if(depth >= json_max_nesting) too_deep();
+      append("{", 1);
+      entry_context ctx = { this, depth + 1, true };
+      mrb_hash_foreach(m_mrb, RHASH(val), &emit_entry, &ctx);
+      append("}", 1);
+      break;
+    }
+    default: {
+      int ai = mrb_gc_arena_save(m_mrb);
+      mrb_value str = mrb_obj_as_string(m_mrb, val);
+      emit_string(RSTRING_PTR(str), RSTRING_LEN(str));
+      mrb_gc_arena_restore(m_mrb, ai);
+    }
+    }
+  }
+
+  private:
+
+  struct entry_context {
+    json_emitter* emitter;
+    int           depth;
+    bool          first;
+  };
+
+  static int emit_entry(mrb_state* mrb, mrb_value key, mrb_value val, void* data) {
+    auto ctx = static_cast<entry_context*>(data);
+    json_emitter* self = ctx->emitter;
+    if(!ctx->first) self->append(",", 1);
+    ctx->first = false;
+    if(mrb_string_p(key) || mrb_symbol_p(key)) {
+      self->emit(key, ctx->depth);
+    } else {
+      int ai = mrb_gc_arena_save(mrb);
+      mrb_value str = mrb_obj_as_string(mrb, key);
+      self->emit_string(RSTRING_PTR(str), RSTRING_LEN(str));
+      mrb_gc_arena_restore(mrb, ai);
+    }
+    self->append(":", 1);
+    self->emit(val, ctx->depth);
+    return 0;
+  }
+
+  [[noreturn]] void too_deep() {
+    mrb_raisef(m_mrb, m_error, "nesting of %S is too deep", mrb_fixnum_value(json_max_nesting + 1));
+  }
+
+  void append(const char* p, size_t len) {
+    mrb_str_cat(m_mrb, m_out, p, len);
+  }
+
+  void emit_integer(mrb_int v) {
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    uint64_t u = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+    do {
+      *--p = static_cast<char>('0' + u % 10);
+      u /= 10;
+    } while(u);
+    if(v < 0) *--p = '-';
+    append(p, buf + sizeof(buf) - p);
+  }
+
+  void emit_float(double d) {
+    if(std::isnan(d) || std::isinf(d))
+      mrb_raisef(m_mrb, m_error, "%S not allowed in JSON", mrb_float_value(m_mrb, d));
+    // shortest representation that reads back as the same double
+    char buf[32];
+    int len = 0;
+    for(int precision = 15; precision <= 17; precision++) {
+      len = std::snprintf(buf, sizeof(buf), "%.*g", precision, d);
+      if(std::strtod(buf, nullptr) == d) break;
+    }
+    append(buf, len);
+    if(!std::strpbrk(buf, ".e")) append(".0", 2);
+  }
+
+  void emit_string(const char* p, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    const char* end = p + len;
+    append("\"", 1);
+    for(;;) {
+      const char* special = json_find_special(p, end);
+      if(special != p) append(p, special - p);
+      if(special == end) break;
+      char c = *special;
+      switch(c) {
+      case '"':  append("\\\"", 2); break;
+      case '\\': append("\\\\", 2); break;
+      case '\b': append("\\b", 2);  break;
+      case '\f': append("\\f", 2);  break;
+      case '\n': append("\\n", 2);  break;
+      case '\r': append("\\r", 2);  break;
+      case '\t': append("\\t", 2);  break;
+      default: {
+        char esc[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf] };
+        append(esc, 6);
+      }
+      }
+      p = special + 1;
+    }
+    append("\"", 1);
+  }
+
+  mrb_state*     m_mrb;
+  struct RClass* m_error;
+  mrb_value      m_out;
+};
+
+MRBIND14_INLINE mrb_value json_parse(mrb_state* mrb, mrb_value self) {
+  char* data;
+  mrb_int len;
+  mrb_get_args(mrb, "s", &data, &len);
+  json_parser parser(mrb, mrb_class_get_under(mrb, mrb_class_ptr(self), "ParserError"), data, len);
+  return parser.parse();
+}
+
+MRBIND14_INLINE mrb_value json_generate(mrb_state* mrb, mrb_value self) {
+  mrb_value val;
+  mrb_get_args(mrb, "o", &val);
+  json_emitter emitter(mrb, mrb_class_get_under(mrb, mrb_class_ptr(self), "GeneratorError"));
+  emitter.emit(val);
+  return emitter.result();
+}
+
+} // namespace detail
+
+MRBIND14_INLINE module module::def_json_module(const char* name) {
+  module json = def_module(name);
+  struct RClass* error = mrb_define_class_under(m_mrb, json.m_module, "JSONError",
+      mrb_class_get(m_mrb, "StandardError"));
+  mrb_define_class_under(m_mrb, json.m_module, "ParserError", error);
+  mrb_define_class_under(m_mrb, json.m_module, "GeneratorError", error);
+  mrb_define_module_function(m_mrb, json.m_module, "parse",    &detail::json_parse,    MRB_ARGS_REQ(1));
+  mrb_define_module_function(m_mrb, json.m_module, "generate", &detail::json_generate, MRB_ARGS_REQ(1));
+  mrb_define_module_function(m_mrb, json.m_module, "dump",     &detail::json_generate, MRB_ARGS_REQ(1));
+  return json;
+}
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_MAPPED_FILE_H_
+#define MRBIND14_MAPPED_FILE_H_
+
+/// Files are memory-mapped on POSIX systems, and read into memory
+/// elsewhere. Define MRBIND14_USE_MMAP to 0 or 1 to override.
+#ifndef MRBIND14_USE_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define MRBIND14_USE_MMAP 1
+#else
+#define MRBIND14_USE_MMAP 0
+#endif
+#endif
+
+#include <string>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#if MRBIND14_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <sstream>
+#endif
+
+namespace mrbind14 {
+
+namespace detail {
+
+#if MRBIND14_USE_MMAP
+
+/// Read-only memory mapping of a whole file, unmapped on destruction
+class mapped_file {
+
+  public:
+
+  explicit mapped_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) fail(path, errno);
+    struct stat st;
+    if(::fstat(fd, &st) != 0) {
+      int err = errno;
+      ::close(fd);
+      fail(path, err);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if(m_size > 0) {
+      void* addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(addr == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        fail(path, err);
+      }
+      ::madvise(addr, m_size, MADV_SEQUENTIAL);
+      m_data = static_cast<const char*>(addr);
+    }
+    ::close(fd);
+  }
+
+  mapped_file(const mapped_file&) = delete;
+
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file() {
+    if(m_size > 0) ::munmap(const_cast<char*>(m_data), m_size);
+  }
+
+  const char* data() const {
+    return m_data;
+  }
+
+  size_t size() const {
+    return m_size;
+  }
+
+  private:
+
+  [[noreturn]] static void fail(const std::string& path, int err) {
+    throw std::runtime_error("Could not map file " + path + ": " + std::strerror(err));
+  }
+
+  const char* m_data = "";
+  size_t      m_size = 0;
+};
+
+#else
+
+/// Contents of a whole file, read into memory
+class mapped_file {
+
+  public:
+
+  explicit mapped_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) throw std::runtime_error("Could not open file " + path + ": " + std::strerror(errno));
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    if(in.bad()) throw std::runtime_error("Could not read file " + path);
+    m_contents = contents.str();
+  }
+
+  mapped_file(const mapped_file&) = delete;
+
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  const char* data() const {
+    return m_contents.data();
+  }
+
+  size_t size() const {
+    return m_contents.size();
+  }
+
+  private:
+
+  std::string m_contents;
+};
+
+#endif
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
@@ -0,0 +1,286 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_MEMOIZE_H_
+#define MRBIND14_MEMOIZE_H_
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/string.h>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+namespace mrbind14 {
+
+/**
+ * @brief Annotation making a bound function cache its results, keyed
+ * on its arguments, in a cache holding at most capacity entries (the
+ * least recently used entry is evicted first):
+ *
+ *   mod.def_function("geocode", geocode, mrbind14::memoize(4096));
+ *
+ * Calls whose arguments are all nil, booleans, integers, floats,
+ * symbols or strings are looked up in the cache, and a hit returns
+ * without converting the arguments nor calling the function. Calls
+ * with other arguments always go to the function. Cached strings are
+ * copied when returned; other cached objects are shared by all the
+ * calls returning them. Each interpreter has its own cache. With
+ * MRBIND14_ENABLE_PROFILING, hits count as calls in the function's
+ * profile, with no conversion time.
+ *
+ * Only free functions without a block parameter can be memoized.
+ */
+class memoize {
+
+  public:
+
+  explicit memoize(size_t capacity = 1024)
+  : m_capacity(capacity) {}
+
+  size_t capacity() const {
+    return m_capacity;
+  }
+
+  private:
+
+  size_t m_capacity;
+};
+
+/**
+ * @brief Annotation marking a bound function as pure, i.e. returning
+ * the same result for the same arguments. Equivalent to memoize().
+ */
+inline memoize pure() {
+  return memoize();
+}
+
+/**
+ * @brief Counters of the cache of a memoized function.
+ */
+struct memo_stats {
+  std::string name;
+  uint64_t    hits      = 0; // calls answered from the cache
+  uint64_t    misses    = 0; // calls looked up and not found
+  uint64_t    uncached  = 0; // calls with arguments that cannot be cached
+  uint64_t    evictions = 0; // entries evicted to make room for new ones
+  size_t      size      = 0; // current number of entries
+  size_t      capacity  = 0; // maximum number of entries
+
+  double hit_rate() const {
+    uint64_t lookups = hits + misses;
+    return lookups ? double(hits) / lookups : 0.0;
+  }
+};
+
+namespace detail {
+
+/// Checks if a list of extra attributes contains a memoize annotation
+template<typename ... Extra>
+struct has_memoize;
+
+template<>
+struct has_memoize<> : std::false_type {};
+
+template<typename E1, typename ... Extra>
+struct has_memoize<E1, Extra...>
+  : std::integral_constant<bool, std::is_same<E1, memoize>::value
+                              || has_memoize<Extra...>::value> {};
+
+inline void set_memoize_capacity(size_t& result, const memoize& m) {
+  result = m.capacity();
+}
+
+template<typename T>
+void set_memoize_capacity(size_t&, const T&) {}
+
+/// Returns the capacity of the last memoize annotation among a list of
+/// extra attributes, or 0 if there is none
+template<typename ... Extra>
+size_t find_memoize_capacity(const Extra&... extra) {
+  size_t result = 0;
+  int dummy[] = { 0, (set_memoize_capacity(result, extra), 0)... };
+  (void)dummy;
+  return result;
+}
+
+/// Bounded LRU cache of the results of a memoized function in one
+/// interpreter. Keys are the arguments of a call encoded as bytes (type
+/// tag followed by the value), so that equal keys mean equal arguments
+/// regardless of hash collisions. Cached results are kept in a Ruby
+/// Array registered with the GC, each entry owning one slot of it.
+class memo_cache {
+
+  struct entry {
+    std::list<const std::string*>::iterator position;
+    mrb_int                                 slot;
+  };
+
+  using map_type = std::unordered_map<std::string, entry>;
+
+  public:
+
+  explicit memo_cache(size_t capacity)
+  : m_capacity(capacity ? capacity : 1) {
+    m_entries.reserve(m_capacity);
+  }
+
+  void initialize(mrb_state* mrb) {
+    m_results = mrb_ary_new_capa(mrb, m_capacity);
+    mrb_gc_register(mrb, m_results);
+  }
+
+  /// Buffer in which keys are built, so that building a key does not
+  /// allocate once the buffer has grown to the size of the keys
+  std::string& buffer() {
+    return m_buffer;
+  }
+
+  /// Whether the function is running, i.e. a call has found no result
+  /// and has not inserted its own yet. A Ruby exception leaving the
+  /// function leaves the cache running, which is safe: calls then build
+  /// their keys in buffers of their own.
+  bool running() const {
+    return m_depth > 0;
+  }
+
+  void enter() {
+    m_depth += 1;
+  }
+
+  void leave() {
+    m_depth -= 1;
+  }
+
+  /// Encodes the arguments into a key. Returns false, and counts the
+  /// call as uncached, if an argument cannot be part of a key.
+  bool make_key(unsigned nargs, const mrb_value* args, std::string& key) {
+    key.clear();
+    for(unsigned i = 0; i < nargs; i++) {
+      if(!append(key, args[i])) {
+        m_stats.uncached += 1;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Looks up a key, marking its entry as the most recently used
+  bool find(mrb_state* mrb, const std::string& key, mrb_value& result) {
+    auto it = m_entries.find(key);
+    if(it == m_entries.end()) {
+      m_stats.misses += 1;
+      return false;
+    }
+    m_stats.hits += 1;
+    m_order.splice(m_order.begin(), m_order, it->second.position);
+    result = share(mrb, mrb_ary_ref(mrb, m_results, it->second.slot));
+    return true;
+  }
+
+  /// Associates a result to the key, evicting the least recently used
+  /// entry if the cache is full. The key is copied only for new entries.
+  /// It may have been inserted since it was looked up, by a call of the
+  /// function made from the function.
+  void insert(mrb_state* mrb, const std::string& key, mrb_value result) {
+    auto found = m_entries.find(key);
+    if(found != m_entries.end()) {
+      m_order.splice(m_order.begin(), m_order, found->second.position);
+      mrb_ary_set(mrb, m_results, found->second.slot, share(mrb, result));
+      return;
+    }
+    mrb_int slot = m_entries.size();
+    if(m_entries.size() == m_capacity) {
+      auto lru = m_entries.find(*m_order.back());
+      slot = lru->second.slot;
+      m_order.pop_back();
+      m_entries.erase(lru);
+      m_stats.evictions += 1;
+    }
+    auto it = m_entries.emplace(key, entry{ m_order.end(), slot }).first;
+    m_order.push_front(&it->first);
+    it->second.position = m_order.begin();
+    mrb_ary_set(mrb, m_results, slot, share(mrb, result));
+  }
+
+  void clear(mrb_state* mrb) {
+    m_entries.clear();
+    m_order.clear();
+    mrb_ary_clear(mrb, m_results);
+  }
+
+  memo_stats stats() const {
+    memo_stats s = m_stats;
+    s.size     = m_entries.size();
+    s.capacity = m_capacity;
+    return s;
+  }
+
+  void reset_stats() {
+    m_stats = memo_stats();
+  }
+
+  private:
+
+  template<typename T>
+  static void append_bytes(std::string& key, const T& value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  static bool append(std::string& key, mrb_value val) {
+    auto type = mrb_type(val);
+    switch(type) {
+      case MRB_TT_FALSE:
+        key.push_back(mrb_nil_p(val) ? 'n' : 'f');
+        return true;
+      case MRB_TT_TRUE:
+        key.push_back('t');
+        return true;
+      case MRB_TT_FIXNUM:
+        key.push_back('i');
+        append_bytes(key, mrb_fixnum(val));
+        return true;
+      case MRB_TT_FLOAT:
+        key.push_back('d');
+        append_bytes(key, mrb_float(val));
+        return true;
+      case MRB_TT_SYMBOL:
+        key.push_back('y');
+        append_bytes(key, mrb_symbol(val));
+        return true;
+      case MRB_TT_STRING: {
+        mrb_int len = RSTRING_LEN(val);
+        key.push_back('s');
+        append_bytes(key, len);
+        key.append(RSTRING_PTR(val), len);
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+
+  /// Strings are mutable, so the cache and the callers get their own copy
+  static mrb_value share(mrb_state* mrb, mrb_value val) {
+    return mrb_string_p(val) ? mrb_str_dup(mrb, val) : val;
+  }
+
+  size_t                        m_capacity;
+  mrb_value                     m_results = mrb_nil_value();
+  map_type                      m_entries;
+  std::list<const std::string*> m_order;
+  std::string                   m_buffer;
+  unsigned                      m_depth = 0;
+  memo_stats                    m_stats;
+};
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
@@ -9,14 +9,26 @@
 //#include <mrbind14/function_binder.hpp>
 #include <mrbind14/cpp_function.hpp>
 #include <mrbind14/type_binder.hpp>
+#include <mrbind14/state.hpp>
+#include <mrbind14/gc.hpp>
 #include <mruby/value.h>
+#include <mruby/class.h>
 #include <string>
 #include <exception>
+#include <algorithm>
+#include <cctype>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace mrbind14 {
 
 class object;
 
+template<typename T>
+class class_;
+
 class module {
 
     friend class object;
@@ -25,15 +37,62 @@ class module {
 
     template<typename Function, typename ... Extra>
     module& def_function(const char* name, Function&& f, const Extra&... extra) {
-        void* p = mrb_malloc_simple(m_mrb, sizeof(function));
-        auto fptr = new(p) function(name, std::forward<Function>(f), extra...);
-        std::string name_cptr = std::string("__") + name + "__cptr__";
-        mrb_sym name_cptr_sym = mrb_intern_cstr(m_mrb, name_cptr.c_str());
-        mrb_mod_cv_set(m_mrb, m_module, name_cptr_sym, mrb_cptr_value(m_mrb, (void*)fptr));
-        mrb_define_module_function(m_mrb, m_module, name, function_overload_resolver,  MRB_ARGS_ANY());
+        auto& functions = detail::get_state_data(m_mrb).functions;
+        functions.push_back(std::make_unique<function>(name, std::forward<Function>(f), extra...));
+        auto fptr = functions.back().get();
+        fptr->initialize(m_mrb);
+        detail::define_module_function(m_mrb, m_module, name, fptr);
         return *this;
     }
 
+    /**
+     * @brief Defines a function taking numbers, booleans or strings that
+     * can also be called with Arrays (see vectorize.hpp). When at least
+     * one argument is an Array, the function is applied element-wise in
+     * a single call and returns an Array; scalar arguments are repeated
+     * for all the elements and Arrays must all have the same length:
+     *
+     *   mod.def_vectorized("score", [](double x, double y) { return x*y; });
+     *   # score([1.0, 2.0], 3.0) => [3.0, 6.0]
+     *
+     * @param name Name of the function.
+     * @param f Function, function pointer or lambda.
+     * @param extra Annotations, applied to the scalar form.
+     *
+     * @return A reference to the current module.
+     */
+    template<typename Function, typename ... Extra>
+    module& def_vectorized(const char* name, Function&& f, const Extra&... extra);
+
+    /**
+     * @brief Defines a class inside this module, bound to the C++ type T.
+     * Objects of this class wrap a T, and methods and constructors can
+     * be added to it using the returned class_ object (see class.hpp).
+     *
+     * @tparam T C++ type.
+     * @param name Name of the new class.
+     *
+     * @return The newly created class.
+     */
+    template<typename T>
+    class_<T> def_class(const char* name);
+
+    /**
+     * @brief Defines a constant holding a frozen SharedTable proxy to a
+     * read-only C++ container (see shared_table.hpp). The container is
+     * not copied: interpreters given the same table all read the same
+     * memory, without locking, so it must not be modified while shared.
+     *
+     * @tparam Container Associative container, sorted vector of pairs,
+     * or vector (indexed by integers).
+     * @param name Name of the constant.
+     * @param table Container to share.
+     *
+     * @return A reference to the current module.
+     */
+    template<typename Container>
+    module& def_shared_table(const char* name, std::shared_ptr<Container> table);
+
     /**
      * @brief Defines a module inside this module.
      *
@@ -46,6 +105,54 @@ class module {
         return module(m_mrb, mod, name);
     }
 
+    /**
+     * @brief Defines a module inside this module with native JSON.parse
+     * and JSON.generate (alias JSON.dump) functions. The parser builds
+     * Ruby values directly from the input and the generator writes into
+     * a Ruby string, without intermediate representation (see json.hpp).
+     * Errors are raised as JSON::ParserError and JSON::GeneratorError,
+     * both subclasses of JSON::JSONError.
+     *
+     * @param name Name of the new module.
+     *
+     * @return The newly created module.
+     */
+    module def_json_module(const char* name = "JSON");
+
+    /**
+     * @brief Registers a module inside this module without creating it.
+     * The module is created and passed to the initializer the first time
+     * a script refers to it (through const_missing), so the cost of the
+     * functions, classes and constants it defines is only paid by the
+     * scripts that use it. Note that defined?(Name) does not trigger
+     * const_missing, hence returns nil until the module is created.
+     *
+     *   mruby.def_lazy_module("Geometry", [](mrbind14::module& geo) {
+     *     geo.def_function("area", area);
+     *   });
+     *
+     * @param name Name of the module.
+     * @param init Function populating the module.
+     *
+     * @return A reference to the current module.
+     */
+    template<typename Initializer>
+    module& def_lazy_module(const char* name, Initializer&& init) {
+        auto& state = detail::get_state_data(m_mrb);
+        if(!state.lazy_hook_installed) {
+            struct RClass* mod_class = m_mrb->module_class;
+            mrb_alias_method(m_mrb, mod_class,
+                mrb_intern_lit(m_mrb, "__mrbind14_const_missing__"),
+                mrb_intern_lit(m_mrb, "const_missing"));
+            mrb_define_method(m_mrb, mod_class, "const_missing",
+                &module::lazy_const_missing, MRB_ARGS_REQ(1));
+            state.lazy_hook_installed = true;
+        }
+        state.lazy_modules[std::make_pair(m_module, mrb_intern_cstr(m_mrb, name))] =
+            std::forward<Initializer>(init);
+        return *this;
+    }
+
     /**
      * @brief Defines a constant inside this module.
      *
@@ -57,6 +164,7 @@ class module {
      */
     template<typename ValueType>
     module& def_const(const char* name, const ValueType& val) {
+        gc_arena_scope arena(m_mrb);
         mrb_define_const(m_mrb,
                 m_module,
                 name,
@@ -64,6 +172,47 @@ class module {
         return *this;
     }
 
+    /**
+     * @brief Binds the enum E: defines a module holding one constant per
+     * enumerator (named after the upcased enumerator name), and makes E
+     * convertible from and to Ruby. Values of E are passed to Ruby as
+     * symbols named after the enumerators, and accepted as such symbols
+     * or as integers. With flags, values are integers that can be OR-ed,
+     * and Arrays of symbols are accepted as well.
+     *
+     *   mod.def_enum<Color>("Color", {{"red", Color::red}, {"blue", Color::blue}});
+     *   // Color::RED == :red
+     *
+     * @tparam E Enum type.
+     * @param name Name of the module.
+     * @param enumerators Names and values of the enumerators.
+     * @param flags Whether E is a set of bitflags.
+     *
+     * @return The newly created module.
+     */
+    template<typename E>
+    module def_enum(const char* name,
+                    std::initializer_list<std::pair<const char*, E>> enumerators,
+                    bool flags = false) {
+        static_assert(std::is_enum<E>::value, "def_enum requires an enum type");
+        auto mod = mrb_define_module_under(m_mrb, m_module, name);
+        std::vector<std::pair<mrb_sym, int64_t>> table;
+        for(const auto& e : enumerators) {
+            mrb_sym sym   = mrb_intern_cstr(m_mrb, e.first);
+            int64_t value = static_cast<int64_t>(e.second);
+            table.emplace_back(sym, value);
+            std::string const_name(e.first);
+            std::transform(const_name.begin(), const_name.end(), const_name.begin(),
+                           [](unsigned char c) { return std::toupper(c); });
+            mrb_define_const(m_mrb, mod, const_name.c_str(),
+                             flags ? mrb_fixnum_value(value) : mrb_symbol_value(sym));
+        }
+        detail::set_enum_table<E>(m_mrb,
+            std::make_unique<detail::enum_table>(std::move(table), flags));
+        detail::register_cpp_class_name<E>(m_mrb, name);
+        return module(m_mrb, mod, name);
+    }
+
     /**
      * @brief Includes a module inside the current module.
      *
@@ -126,9 +275,17 @@ class module {
     template<typename ValueType>
     void cv_set(const std::string& variable_name, const ValueType& val) {
         mrb_sym variable_name_sym = mrb_intern_cstr(m_mrb, variable_name.c_str());
+        gc_arena_scope arena(m_mrb);
         mrb_mod_cv_set(m_mrb, m_module, variable_name_sym, detail::cpp_to_mrb(m_mrb, val));
     }
 
+    /**
+     * @brief Returns the underlying MRuby state.
+     */
+    mrb_state* mrb() const {
+        return m_mrb;
+    }
+
     protected:
 
     mrb_state*     m_mrb    = nullptr;
@@ -141,8 +298,40 @@ class module {
     module(mrb_state* mrb, struct RClass* mod, const char* name)
         : m_mrb(mrb), m_name(name), m_module(mod) {}
 
+    private:
+
+    /// Module#const_missing: creates the lazy module registered under
+    /// this name in the receiver or one of its ancestors, if any, and
+    /// falls back to the original const_missing otherwise
+    static mrb_value lazy_const_missing(mrb_state* mrb, mrb_value self) {
+        mrb_sym name;
+        mrb_get_args(mrb, "n", &name);
+        auto& lazy_modules = detail::get_state_data(mrb).lazy_modules;
+        for(struct RClass* c = mrb_class_ptr(self); c; c = c->super) {
+            struct RClass* owner = c->tt == MRB_TT_ICLASS ? c->c : c;
+            auto it = lazy_modules.find(std::make_pair(owner, name));
+            if(it == lazy_modules.end()) continue;
+            auto init = std::move(it->second);
+            lazy_modules.erase(it);
+            const char* name_str = mrb_sym2name(mrb, name);
+            module mod(mrb, mrb_define_module_under(mrb, owner, name_str), name_str);
+            init(mod);
+            return mrb_obj_value(mod.m_module);
+        }
+        mrb_value arg = mrb_symbol_value(name);
+        return mrb_funcall_argv(mrb, self, mrb_intern_lit(mrb, "__mrbind14_const_missing__"), 1, &arg);
+    }
+
 };
 
+namespace detail {
+
+#if MRBIND14_DEFINITIONS
+MRBIND14_INLINE state_data::~state_data() = default;
+#endif
+
+} // namespace detail
+
 }
 
 #endif
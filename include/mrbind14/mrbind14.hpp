@@ -7,5 +7,9 @@
 #define MRBIND14_HPP_
 
 #include <mrbind14/interpreter.hpp>
+#include <mrbind14/session.hpp>
+#include <mrbind14/parallel.hpp>
+#include <mrbind14/msgpack.hpp>
+#include <mrbind14/script_registry.hpp>
 
 #endif
@@ -1,18 +1,36 @@
 #ifndef MRBIND14_MRUBY_UTIL_H_
 #define MRBIND14_MRUBY_UTIL_H_
 
+#include <mrbind14/config.hpp>
 #include <mruby.h>
 #include <mruby/class.h>
 
 /// Helper function to define a class method
-inline void mrb_define_class_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, mrb_method_t method)
+MRBIND14_INLINE void mrb_define_class_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, mrb_method_t method);
+
+/// Function to raise an "invalid number of arguments" exception
+MRBIND14_INLINE void raise_invalid_nargs(
+    mrb_state *mrb,
+    mrb_value func_name,
+    int narg,
+    int nparam);
+
+/// Function to raise an "invalid argument type" exception
+MRBIND14_INLINE void raise_invalid_type(
+    mrb_state *mrb,
+    int parameter_index,
+    const char* required_type_name,
+    mrb_value value);
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE void mrb_define_class_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, mrb_method_t method)
 {
   mrb_define_class_method(mrb, c, mrb_sym2name(mrb, mid), NULL, MRB_ARGS_ANY());
   mrb_define_method_raw(mrb, ((RObject*)c)->c, mid, method);
 }
 
-/// Function to raise an "invalid number of arguments" exception
-inline void raise_invalid_nargs(
+MRBIND14_INLINE void raise_invalid_nargs(
     mrb_state *mrb,
     mrb_value func_name,
     int narg,
@@ -23,8 +41,7 @@ inline void raise_invalid_nargs(
              mrb_fixnum_value(nparam));
 }
 
-/// Function to raise an "invalid argument type" exception
-inline void raise_invalid_type(
+MRBIND14_INLINE void raise_invalid_type(
     mrb_state *mrb,
     int parameter_index,
     const char* required_type_name,
@@ -37,3 +54,5 @@ inline void raise_invalid_type(
 }
 
 #endif
+
+#endif
@@ -0,0 +1,504 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_MSGPACK_H_
+#define MRBIND14_MSGPACK_H_
+
+#include <mrbind14/object.hpp>
+#include <mrbind14/module.hpp>
+#include <mrbind14/gc.hpp>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+namespace mrbind14 {
+
+#if MRBIND14_DEFINITIONS
+
+namespace detail {
+
+/// Values nested deeper than this are rejected, which also catches
+/// self-referencing arrays and hashes
+constexpr int msgpack_max_depth = 256;
+
+/// MessagePack extension type used for Ruby symbols
+constexpr int8_t msgpack_symbol_type = 0;
+
+[[noreturn]] MRBIND14_INLINE void unsupported_value(mrb_state* mrb, mrb_value val) {
+  throw std::runtime_error(std::string("Cannot serialize value of class ")
+      + mrb_obj_classname(mrb, val));
+}
+
+[[noreturn]] MRBIND14_INLINE void too_deep() {
+  throw std::runtime_error("Value nested too deeply");
+}
+
+/// Writes mrb_values in MessagePack format at the end of a buffer
+class msgpack_writer {
+
+  public:
+
+  explicit msgpack_writer(std::string& out)
+  : m_out(out) {}
+
+  void write(mrb_state* mrb, mrb_value val, int depth = 0) {
+    if(depth > msgpack_max_depth) too_deep();
+    switch(mrb_type(val)) {
+    case MRB_TT_FALSE:
+      put(mrb_nil_p(val) ? 0xc0 : 0xc2);
+      break;
+    case MRB_TT_TRUE:
+      put(0xc3);
+      break;
+    case MRB_TT_FIXNUM:
+      write_int(mrb_fixnum(val));
+      break;
+    case MRB_TT_FLOAT: {
+      double d = mrb_float(val);
+      uint64_t bits;
+      std::memcpy(&bits, &d, sizeof(bits));
+      put_be<uint64_t>(0xcb, bits);
+      break;
+    }
+    case MRB_TT_STRING:
+      write_header(RSTRING_LEN(val), 0xa0, 31, 0xd9, 0xda, 0xdb);
+      m_out.append(RSTRING_PTR(val), RSTRING_LEN(val));
+      break;
+    case MRB_TT_SYMBOL: {
+      mrb_int len;
+      const char* name = mrb_sym2name_len(mrb, mrb_symbol(val), &len);
+      write_ext_header(len);
+      m_out.append(name, len);
+      break;
+    }
+    case MRB_TT_ARRAY: {
+      mrb_int len = RARRAY_LEN(val);
+      write_header(len, 0x90, 15, 0, 0xdc, 0xdd);
+      for(mrb_int i = 0; i < len; i++)
+        write(mrb, RARRAY_PTR(val)[i], depth + 1);
+      break;
+    }
+    case MRB_TT_HASH: {
+      size_t len = 0;
+      mrb_hash_foreach(mrb, RHASH(val), &count_entry, &len);
+      write_header(len, 0x80, 15, 0, 0xde, 0xdf);
+      entry_context ctx = { this, depth + 1, nullptr };
+      mrb_hash_foreach(mrb, RHASH(val), &write_entry, &ctx);
+      if(ctx.error) std::rethrow_exception(ctx.error);
+      break;
+    }
+    default:
+      unsupported_value(mrb, val);
+    }
+  }
+
+  private:
+
+  // C++ exceptions must not unwind through mrb_hash_foreach: they are
+  // caught in the callbacks, which stop the iteration, and rethrown
+  // once it has returned.
+
+  struct entry_context {
+    msgpack_writer*    writer;
+    int                depth;
+    std::exception_ptr error;
+  };
+
+  static int count_entry(mrb_state* mrb, mrb_value key, mrb_value val, void* data) {
+    *static_cast<size_t*>(data) += 1;
+    return 0;
+  }
+
+  static int write_entry(mrb_state* mrb, mrb_value key, mrb_value val, void* data) {
+    auto ctx = static_cast<entry_context*>(data);
+    try {
+      ctx->writer->write(mrb, key, ctx->depth);
+      ctx->writer->write(mrb, val, ctx->depth);
+    } catch(...) {
+      ctx->error = std::current_exception();
+      return 1;
+    }
+    return 0;
+  }
+
+  void put(uint8_t byte) {
+    m_out.push_back(static_cast<char>(byte));
+  }
+
+  template<typename U>
+  void put_be(uint8_t tag, U v) {
+    char buf[1 + sizeof(U)];
+    buf[0] = static_cast<char>(tag);
+    for(size_t i = 0; i < sizeof(U); i++)
+      buf[1+i] = static_cast<char>(v >> (8 * (sizeof(U) - 1 - i)));
+    m_out.append(buf, sizeof(buf));
+  }
+
+  void write_int(int64_t v) {
+    if(v >= 0) {
+      if(v <= 0x7f)            put(static_cast<uint8_t>(v));
+      else if(v <= UINT8_MAX)  put_be<uint8_t>(0xcc, v);
+      else if(v <= UINT16_MAX) put_be<uint16_t>(0xcd, v);
+      else if(v <= UINT32_MAX) put_be<uint32_t>(0xce, v);
+      else                     put_be<uint64_t>(0xcf, v);
+    } else {
+      if(v >= -32)             put(static_cast<uint8_t>(v));
+      else if(v >= INT8_MIN)   put_be<uint8_t>(0xd0, static_cast<uint8_t>(v));
+      else if(v >= INT16_MIN)  put_be<uint16_t>(0xd1, static_cast<uint16_t>(v));
+      else if(v >= INT32_MIN)  put_be<uint32_t>(0xd2, static_cast<uint32_t>(v));
+      else                     put_be<uint64_t>(0xd3, static_cast<uint64_t>(v));
+    }
+  }
+
+  /// Writes the header of a string, array or map: a "fix" form if len
+  /// is at most fix_max, otherwise a 8 (if available), 16 or 32-bit form
+  void write_header(size_t len, uint8_t fix, size_t fix_max,
+                    uint8_t tag8, uint8_t tag16, uint8_t tag32) {
+    if(len <= fix_max)                put(static_cast<uint8_t>(fix | len));
+    else if(tag8 && len <= UINT8_MAX) put_be<uint8_t>(tag8, len);
+    else if(len <= UINT16_MAX)        put_be<uint16_t>(tag16, len);
+    else if(len <= UINT32_MAX)        put_be<uint32_t>(tag32, len);
+    else throw std::runtime_error("Value too large to serialize");
+  }
+
+  void write_ext_header(size_t len) {
+    switch(len) {
+    case 1:  put(0xd4); break;
+    case 2:  put(0xd5); break;
+    case 4:  put(0xd6); break;
+    case 8:  put(0xd7); break;
+    case 16: put(0xd8); break;
+    default:
+      if(len <= UINT8_MAX)       put_be<uint8_t>(0xc7, len);
+      else if(len <= UINT16_MAX) put_be<uint16_t>(0xc8, len);
+      else                       put_be<uint32_t>(0xc9, len);
+    }
+    put(msgpack_symbol_type);
+  }
+
+  std::string& m_out;
+};
+
+/// Reads MessagePack data and builds the corresponding mrb_values
+class msgpack_reader {
+
+  public:
+
+  msgpack_reader(const char* data, size_t size)
+  : m_pos(reinterpret_cast<const uint8_t*>(data))
+  , m_end(m_pos + size) {}
+
+  bool done() const {
+    return m_pos == m_end;
+  }
+
+  mrb_value read(mrb_state* mrb, int depth = 0) {
+    if(depth > msgpack_max_depth) too_deep();
+    uint8_t tag = *take(1);
+    if(tag <= 0x7f) return mrb_fixnum_value(tag);
+    if(tag >= 0xe0) return mrb_fixnum_value(static_cast<int8_t>(tag));
+    if((tag & 0xe0) == 0xa0) return read_str(mrb, tag & 0x1f);
+    if((tag & 0xf0) == 0x90) return read_array(mrb, tag & 0x0f, depth);
+    if((tag & 0xf0) == 0x80) return read_map(mrb, tag & 0x0f, depth);
+    switch(tag) {
+    case 0xc0: return mrb_nil_value();
+    case 0xc2: return mrb_false_value();
+    case 0xc3: return mrb_true_value();
+    case 0xc4: case 0xd9: return read_str(mrb, get_be<uint8_t>());
+    case 0xc5: case 0xda: return read_str(mrb, get_be<uint16_t>());
+    case 0xc6: case 0xdb: return read_str(mrb, get_be<uint32_t>());
+    case 0xc7: return read_ext(mrb, get_be<uint8_t>());
+    case 0xc8: return read_ext(mrb, get_be<uint16_t>());
+    case 0xc9: return read_ext(mrb, get_be<uint32_t>());
+    case 0xca: {
+      uint32_t bits = get_be<uint32_t>();
+      float f;
+      std::memcpy(&f, &bits, sizeof(f));
+      return mrb_float_value(mrb, f);
+    }
+    case 0xcb: {
+      uint64_t bits = get_be<uint64_t>();
+      double d;
+      std::memcpy(&d, &bits, sizeof(d));
+      return mrb_float_value(mrb, d);
+    }
+    case 0xcc: return int_value(mrb, get_be<uint8_t>());
+    case 0xcd: return int_value(mrb, get_be<uint16_t>());
+    case 0xce: return int_value(mrb, get_be<uint32_t>());
+    case 0xcf: {
+      uint64_t v = get_be<uint64_t>();
+      if(v > INT64_MAX) return mrb_float_value(mrb, static_cast<mrb_float>(v));
+      return int_value(mrb, static_cast<int64_t>(v));
+    }
+    case 0xd0: return int_value(mrb, static_cast<int8_t>(get_be<uint8_t>()));
+    case 0xd1: return int_value(mrb, static_cast<int16_t>(get_be<uint16_t>()));
+    case 0xd2: return int_value(mrb, static_cast<int32_t>(get_be<uint32_t>()));
+    case 0xd3: return int_value(mrb, static_cast<int64_t>(get_be<uint64_t>()));
+    case 0xd4: return read_ext(mrb, 1);
+    case 0xd5: return read_ext(mrb, 2);
+    case 0xd6: return read_ext(mrb, 4);
+    case 0xd7: return read_ext(mrb, 8);
+    case 0xd8: return read_ext(mrb, 16);
+    case 0xdc: return read_array(mrb, get_be<uint16_t>(), depth);
+    case 0xdd: return read_array(mrb, get_be<uint32_t>(), depth);
+    case 0xde: return read_map(mrb, get_be<uint16_t>(), depth);
+    case 0xdf: return read_map(mrb, get_be<uint32_t>(), depth);
+    default:
+      throw std::runtime_error("Invalid MessagePack data");
+    }
+  }
+
+  private:
+
+  const uint8_t* take(size_t n) {
+    if(static_cast<size_t>(m_end - m_pos) < n)
+      throw std::runtime_error("Truncated MessagePack data");
+    const uint8_t* p = m_pos;
+    m_pos += n;
+    return p;
+  }
+
+  template<typename U>
+  U get_be() {
+    const uint8_t* p = take(sizeof(U));
+    U v = 0;
+    for(size_t i = 0; i < sizeof(U); i++) v = static_cast<U>((v << 8) | p[i]);
+    return v;
+  }
+
+  static mrb_value int_value(mrb_state* mrb, int64_t v) {
+    if(v < MRB_INT_MIN || v > MRB_INT_MAX)
+      return mrb_float_value(mrb, static_cast<mrb_float>(v));
+    return mrb_fixnum_value(static_cast<mrb_int>(v));
+  }
+
+  mrb_value read_str(mrb_state* mrb, size_t len) {
+    const char* p = reinterpret_cast<const char*>(take(len));
+    return mrb_str_new(mrb, p, len);
+  }
+
+  mrb_value read_ext(mrb_state* mrb, size_t len) {
+    int8_t type = static_cast<int8_t>(*take(1));
+    const char* p = reinterpret_cast<const char*>(take(len));
+    if(type != msgpack_symbol_type)
+      throw std::runtime_error("Unsupported MessagePack extension type " + std::to_string(type));
+    return mrb_symbol_value(mrb_intern(mrb, p, len));
+  }
+
+  // Each element takes at least one byte, so a length larger than the
+  // remaining data is rejected before allocating anything. Elements are
+  // protected by their container, hence the arena is reset after each.
+
+  mrb_value read_array(mrb_state* mrb, size_t len, int depth) {
+    if(len > static_cast<size_t>(m_end - m_pos)) take(len);
+    mrb_value ary = mrb_ary_new_capa(mrb, len);
+    int ai = mrb_gc_arena_save(mrb);
+    for(size_t i = 0; i < len; i++) {
+      mrb_ary_push(mrb, ary, read(mrb, depth + 1));
+      mrb_gc_arena_restore(mrb, ai);
+    }
+    return ary;
+  }
+
+  mrb_value read_map(mrb_state* mrb, size_t len, int depth) {
+    if(len > static_cast<size_t>(m_end - m_pos) / 2) take(2 * len);
+    mrb_value hash = mrb_hash_new_capa(mrb, len);
+    int ai = mrb_gc_arena_save(mrb);
+    for(size_t i = 0; i < len; i++) {
+      mrb_value key = read(mrb, depth + 1);
+      mrb_value val = read(mrb, depth + 1);
+      mrb_hash_set(mrb, hash, key, val);
+      mrb_gc_arena_restore(mrb, ai);
+    }
+    return hash;
+  }
+
+  const uint8_t* m_pos;
+  const uint8_t* m_end;
+};
+
+/// Copies a value from an interpreter into another, without going
+/// through a buffer. Accepts the same types as msgpack_writer.
+class value_copier {
+
+  public:
+
+  value_copier(mrb_state* from, mrb_state* to)
+  : m_from(from)
+  , m_to(to) {}
+
+  mrb_value copy(mrb_value val, int depth = 0) {
+    if(depth > msgpack_max_depth) too_deep();
+    switch(mrb_type(val)) {
+    case MRB_TT_FALSE:
+    case MRB_TT_TRUE:
+    case MRB_TT_FIXNUM:
+      return val;
+    case MRB_TT_FLOAT:
+      return mrb_float_value(m_to, mrb_float(val));
+    case MRB_TT_STRING:
+      return mrb_str_new(m_to, RSTRING_PTR(val), RSTRING_LEN(val));
+    case MRB_TT_SYMBOL: {
+      mrb_int len;
+      const char* name = mrb_sym2name_len(m_from, mrb_symbol(val), &len);
+      return mrb_symbol_value(mrb_intern(m_to, name, len));
+    }
+    case MRB_TT_ARRAY: {
+      mrb_int len = RARRAY_LEN(val);
+      mrb_value ary = mrb_ary_new_capa(m_to, len);
+      int ai = mrb_gc_arena_save(m_to);
+      for(mrb_int i = 0; i < len; i++) {
+        mrb_ary_push(m_to, ary, copy(RARRAY_PTR(val)[i], depth + 1));
+        mrb_gc_arena_restore(m_to, ai);
+      }
+      return ary;
+    }
+    case MRB_TT_HASH: {
+      entry_context ctx = { this, mrb_hash_new(m_to), depth + 1, nullptr };
+      mrb_hash_foreach(m_from, RHASH(val), &copy_entry, &ctx);
+      if(ctx.error) std::rethrow_exception(ctx.error);
+      return ctx.hash;
+    }
+    default:
+      unsupported_value(m_from, val);
+    }
+  }
+
+  private:
+
+  /// See msgpack_writer::entry_context
+  struct entry_context {
+    value_copier*      copier;
+    mrb_value          hash;
+    int                depth;
+    std::exception_ptr error;
+  };
+
+  static int copy_entry(mrb_state* mrb, mrb_value key, mrb_value val, void* data) {
+    auto ctx = static_cast<entry_context*>(data);
+    mrb_state* to = ctx->copier->m_to;
+    int ai = mrb_gc_arena_save(to);
+    try {
+      mrb_value k = ctx->copier->copy(key, ctx->depth);
+      mrb_value v = ctx->copier->copy(val, ctx->depth);
+      mrb_hash_set(to, ctx->hash, k, v);
+    } catch(...) {
+      ctx->error = std::current_exception();
+      mrb_gc_arena_restore(to, ai);
+      return 1;
+    }
+    mrb_gc_arena_restore(to, ai);
+    return 0;
+  }
+
+  mrb_state* m_from;
+  mrb_state* m_to;
+};
+
+} // namespace detail
+
+#endif
+
+/**
+ * @brief Serializes a Ruby value into MessagePack. The value may be
+ * made of nil, booleans, integers, floats, strings, symbols, arrays and
+ * hashes; symbols are encoded as an extension of type 0. Other values
+ * cause a std::runtime_error to be thrown.
+ *
+ * @param obj Value to serialize.
+ * @param buffer Buffer receiving the data. It is cleared first, so that
+ * its capacity can be reused from one call to the next.
+ */
+MRBIND14_INLINE void serialize(const object& obj, std::string& buffer);
+
+/**
+ * @brief Serializes a Ruby value into MessagePack.
+ *
+ * @param obj Value to serialize.
+ *
+ * @return The MessagePack data.
+ */
+inline std::string serialize(const object& obj) {
+  std::string buffer;
+  serialize(obj, buffer);
+  return buffer;
+}
+
+/**
+ * @brief Builds a Ruby value from MessagePack data in the interpreter
+ * owning the target module. Binary data is converted into strings.
+ *
+ * @param target Module (or interpreter) in which to create the value.
+ * @param data MessagePack data.
+ * @param size Size of the data.
+ *
+ * @return The new value.
+ */
+MRBIND14_INLINE object deserialize(const module& target, const char* data, size_t size);
+
+inline object deserialize(const module& target, const std::string& data) {
+  return deserialize(target, data.data(), data.size());
+}
+
+#if __cplusplus >= 201703L
+inline object deserialize(const module& target, std::string_view data) {
+  return deserialize(target, data.data(), data.size());
+}
+#endif
+
+/**
+ * @brief Copies a Ruby value into the interpreter owning the target
+ * module. This is equivalent to serializing the value and deserializing
+ * it in the target, but the value is built directly, without a buffer.
+ * The caller must be the only one using both interpreters, e.g. two
+ * interpreters of an interpreter_pool outside of parallel_for_each.
+ *
+ * @param obj Value to copy.
+ * @param target Module (or interpreter) in which to create the copy.
+ *
+ * @return The copy.
+ */
+MRBIND14_INLINE object copy_value(const object& obj, const module& target);
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE void serialize(const object& obj, std::string& buffer) {
+  buffer.clear();
+  detail::msgpack_writer writer(buffer);
+  writer.write(obj.mrb(), obj.value());
+}
+
+MRBIND14_INLINE object deserialize(const module& target, const char* data, size_t size) {
+  mrb_state* mrb = target.mrb();
+  detail::msgpack_reader reader(data, size);
+  gc_arena_scope arena(mrb);
+  mrb_value val = reader.read(mrb);
+  if(!reader.done())
+    throw std::runtime_error("Trailing bytes after MessagePack value");
+  return object(mrb, arena.escape(val));
+}
+
+MRBIND14_INLINE object copy_value(const object& obj, const module& target) {
+  mrb_state* mrb = target.mrb();
+  if(mrb == obj.mrb()) return obj;
+  detail::value_copier copier(obj.mrb(), mrb);
+  gc_arena_scope arena(mrb);
+  return object(mrb, arena.escape(copier.copy(obj.value())));
+}
+
+#endif
+
+}
+
+#endif
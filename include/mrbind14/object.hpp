@@ -1,6 +1,7 @@
 #ifndef MRBIND14_OBJECT_H_
 #define MRBIND14_OBJECT_H_
 
+#include <mrbind14/config.hpp>
 #include <mruby.h>
 
 namespace mrbind14 {
@@ -58,22 +59,32 @@ class object {
 
 #include <mrbind14/module.hpp>
 #include <mrbind14/type_binder.hpp>
+#include <mrbind14/gc.hpp>
 
 namespace mrbind14 {
 
-object::object(const module& mod)
+#if MRBIND14_DEFINITIONS
+MRBIND14_INLINE object::object(const module& mod)
 : m_mrb(mod.m_mrb)
 , m_value(mrb_nil_value()) {}
+#endif
+
+// Only the converted value is left in the arena, not the objects
+// created along the way (e.g. the elements of a container).
 
 template<typename T>
 object::object(mrb_state* mrb, T&& val)
-: m_mrb(mrb)
-, m_value(cpp_to_mrb(mrb, val)) {}
+: m_mrb(mrb) {
+  gc_arena_scope arena(mrb);
+  m_value = arena.escape(detail::cpp_to_mrb(mrb, val));
+}
 
 template<typename T>
 object::object(const module& mod, T&& val)
-: m_mrb(mod.m_mrb)
-, m_value(cpp_to_mrb(m_mrb, val)) {}
+: m_mrb(mod.m_mrb) {
+  gc_arena_scope arena(m_mrb);
+  m_value = arena.escape(detail::cpp_to_mrb(m_mrb, val));
+}
 
 template<typename T>
 auto object::as() const {
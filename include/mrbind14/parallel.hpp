@@ -0,0 +1,260 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_PARALLEL_H_
+#define MRBIND14_PARALLEL_H_
+
+#include <mrbind14/interpreter.hpp>
+#include <mrbind14/exception.hpp>
+#include <mrbind14/gc.hpp>
+#include <mruby.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mrbind14 {
+
+/**
+ * @brief Statistics of a worker of an interpreter_pool over one
+ * call to parallel_for_each.
+ */
+struct worker_stats {
+  uint64_t records = 0; // number of records processed
+  uint64_t chunks  = 0; // number of chunks processed
+  uint64_t steals  = 0; // number of ranges stolen from other workers
+  uint64_t busy_ns = 0; // time spent processing chunks, in nanoseconds
+
+  /**
+   * @brief Returns the number of records processed per second of work.
+   */
+  double throughput() const {
+    return busy_ns ? records * 1e9 / busy_ns : 0.0;
+  }
+};
+
+namespace detail {
+
+/// Range of record indices left to a worker. The owner takes chunks
+/// from the front while thieves take half of what remains from the
+/// back, so that a worker finishing early relieves the slowest ones.
+struct alignas(64) work_range {
+
+  std::mutex mutex;
+  size_t     begin = 0;
+  size_t     end   = 0;
+
+  void assign(size_t b, size_t e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    begin = b;
+    end   = e;
+  }
+
+  bool take(size_t grain, size_t& b, size_t& e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(begin == end) return false;
+    b = begin;
+    e = std::min(begin + grain, end);
+    begin = e;
+    return true;
+  }
+
+  bool steal(size_t& b, size_t& e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t n = end - begin;
+    if(n == 0) return false;
+    b = end - (n + 1) / 2;
+    e = end;
+    end = b;
+    return true;
+  }
+};
+
+} // namespace detail
+
+/**
+ * @brief The interpreter_pool class owns one interpreter per worker
+ * thread, all set up with the same bindings, and evaluates a Ruby
+ * transform over large arrays of records in parallel:
+ *
+ *   mrbind14::interpreter_pool pool([](mrbind14::interpreter& mruby) {
+ *       mruby.def_function("scale", [](double x) { return 2*x; });
+ *   });
+ *   std::vector<double> out;
+ *   auto stats = pool.parallel_for_each(records, "->(r) { scale(r) + 1 }", out);
+ *
+ * The script must evaluate to an object responding to call (e.g. a
+ * lambda). It is compiled once per interpreter, then called on each
+ * record. The input is split into one range per worker, processed in
+ * chunks, and workers running out of records steal from the others.
+ * output[i] always holds the result for input[i].
+ *
+ * Each interpreter is only ever used by one thread at a time, but
+ * functions bound in the setup callback are called concurrently from
+ * different interpreters and must be thread-safe.
+ */
+class interpreter_pool {
+
+  public:
+
+  /**
+   * @brief Creates a pool of interpreters.
+   *
+   * @param setup Function called on each interpreter to bind it.
+   * @param num_workers Number of workers (0 for one per hardware thread).
+   */
+  explicit interpreter_pool(const std::function<void(interpreter&)>& setup = {},
+                            size_t num_workers = 0) {
+    if(num_workers == 0) num_workers = std::max(1u, std::thread::hardware_concurrency());
+    m_interpreters.resize(num_workers);
+    if(setup) {
+      for(auto& mruby : m_interpreters) setup(mruby);
+    }
+  }
+
+  interpreter_pool(const interpreter_pool&) = delete;
+
+  interpreter_pool& operator=(const interpreter_pool&) = delete;
+
+  /**
+   * @brief Returns the number of workers.
+   */
+  size_t size() const {
+    return m_interpreters.size();
+  }
+
+  /**
+   * @brief Returns the interpreter of a worker, e.g. to bind additional
+   * functions or set globals. Must not be called during parallel_for_each.
+   */
+  interpreter& operator[](size_t i) {
+    return m_interpreters[i];
+  }
+
+  /**
+   * @brief Calls the object the script evaluates to on each of the
+   * count records of the input, and writes the results to the output.
+   *
+   * @tparam In Type of the records (convertible to Ruby).
+   * @tparam Out Type of the results (convertible from Ruby).
+   * @param input Array of records.
+   * @param count Number of records.
+   * @param script Ruby script evaluating to a callable object.
+   * @param output Array of at least count results.
+   * @param grain Number of records per chunk (0 to choose automatically).
+   *
+   * @return The statistics of each worker.
+   *
+   * If the script or a call raises an exception, the workers stop
+   * and the first exception is rethrown. The content of the output
+   * is then unspecified.
+   */
+  template<typename In, typename Out>
+  std::vector<worker_stats> parallel_for_each(const In* input, size_t count, const char* script,
+                                              Out* output, size_t grain = 0) {
+    size_t n = m_interpreters.size();
+    if(grain == 0) grain = std::max<size_t>(1, count / (n * 64));
+    std::vector<detail::work_range> ranges(n);
+    for(size_t w = 0; w < n; w++)
+      ranges[w].assign(count * w / n, count * (w + 1) / n);
+    std::vector<worker_stats> stats(n);
+    std::atomic<bool>  failed(false);
+    std::exception_ptr error;
+    std::mutex         error_mutex;
+
+    auto work = [&](size_t w) {
+      try {
+        run_worker(w, input, script, output, grain, ranges, stats[w], failed);
+      } catch(...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if(!error) error = std::current_exception();
+        failed = true;
+      }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(n - 1);
+    for(size_t w = 1; w < n; w++)
+      threads.emplace_back(work, w);
+    work(0);
+    for(auto& t : threads) t.join();
+    if(error) std::rethrow_exception(error);
+    return stats;
+  }
+
+  /**
+   * @brief Calls the object the script evaluates to on each record of
+   * the input. The output is resized to the size of the input.
+   */
+  template<typename In, typename Out>
+  std::vector<worker_stats> parallel_for_each(const std::vector<In>& input, const char* script,
+                                              std::vector<Out>& output, size_t grain = 0) {
+    output.resize(input.size());
+    return parallel_for_each(input.data(), input.size(), script, output.data(), grain);
+  }
+
+  private:
+
+  template<typename In, typename Out>
+  void run_worker(size_t w, const In* input, const char* script, Out* output, size_t grain,
+                  std::vector<detail::work_range>& ranges, worker_stats& stats,
+                  const std::atomic<bool>& failed) {
+    interpreter& mruby = m_interpreters[w];
+    mrb_state* mrb = mruby.mrb();
+    mrb_value fun = mruby.execute(script).value();
+    mrb_gc_register(mrb, fun);
+    struct unregister {
+      mrb_state* mrb;
+      mrb_value  fun;
+      ~unregister() { mrb_gc_unregister(mrb, fun); }
+    } guard{mrb, fun};
+    mrb_sym call = mrb_intern_lit(mrb, "call");
+
+    size_t n = ranges.size();
+    size_t b, e;
+    while(!failed) {
+      if(!ranges[w].take(grain, b, e)) {
+        bool stolen = false;
+        for(size_t i = 1; i < n && !stolen; i++)
+          stolen = ranges[(w + i) % n].steal(b, e);
+        if(!stolen) break;
+        stats.steals += 1;
+        ranges[w].assign(b, e);
+        continue;
+      }
+      auto start = std::chrono::steady_clock::now();
+      for(size_t i = b; i < e; i++) {
+        gc_arena_scope arena(mrb);
+        mrb_value arg = detail::cpp_to_mrb(mrb, input[i]);
+        mrb_value result = mrb_funcall_argv(mrb, fun, call, 1, &arg);
+        if(mrb->exc) {
+          mrb_value exc = mrb_obj_value(mrb->exc);
+          mrb->exc = nullptr;
+          exception::translate_and_throw_exception(mrb, exc);
+        }
+        if(!detail::check_type<Out>(mrb, result))
+          throw std::runtime_error("Result for record " + std::to_string(i)
+              + " cannot be converted to " + detail::type_name<Out>(mrb));
+        output[i] = detail::mrb_to_cpp<Out>(mrb, result);
+      }
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      stats.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      stats.records += e - b;
+      stats.chunks  += 1;
+    }
+  }
+
+  std::vector<interpreter> m_interpreters;
+};
+
+}
+
+#endif
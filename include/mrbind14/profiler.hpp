@@ -0,0 +1,176 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_PROFILER_H_
+#define MRBIND14_PROFILER_H_
+
+/// Define MRBIND14_ENABLE_PROFILING to 1 before including mrbind14
+/// to instrument bound function calls. When left to 0, none of the
+/// profiling code is compiled in.
+#ifndef MRBIND14_ENABLE_PROFILING
+#define MRBIND14_ENABLE_PROFILING 0
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace mrbind14 {
+
+/**
+ * @brief Profiling information collected for a bound function.
+ * All durations are in nanoseconds.
+ */
+struct function_profile {
+  std::string name;
+  uint64_t    calls         = 0;
+  uint64_t    total_ns      = 0;
+  uint64_t    max_ns        = 0;
+  uint64_t    conversion_ns = 0;
+};
+
+namespace detail {
+
+constexpr size_t cache_line_size = 64;
+
+/// Counters for a single bound function. Each instance occupies a cache
+/// line of its own, so that functions called from interpreters living
+/// in different threads never write to the same line. This requires the
+/// objects holding them to be allocated with allocate_aligned.
+struct alignas(cache_line_size) call_stats {
+  uint64_t calls         = 0;
+  uint64_t total_ns      = 0;
+  uint64_t max_ns        = 0;
+  uint64_t conversion_ns = 0;
+
+  /// Accumulates the counters of other into this one
+  void add(const call_stats& other) {
+    calls         += other.calls;
+    total_ns      += other.total_ns;
+    conversion_ns += other.conversion_ns;
+    if(other.max_ns > max_ns) max_ns = other.max_ns;
+  }
+};
+
+static_assert(sizeof(call_stats) == cache_line_size, "call_stats must span a cache line");
+
+/// Allocates size bytes aligned on alignment, a power of two. Operator
+/// new only honors alignments beyond that of std::max_align_t from C++17
+/// on, hence this function for over-aligned classes. The address of the
+/// block returned by malloc is stored right before the aligned one.
+inline void* allocate_aligned(size_t size, size_t alignment) {
+  void* raw = std::malloc(size + alignment + sizeof(void*));
+  if(!raw) throw std::bad_alloc();
+  auto addr = reinterpret_cast<uintptr_t>(raw) + sizeof(void*);
+  addr = (addr + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+  reinterpret_cast<void**>(addr)[-1] = raw;
+  return reinterpret_cast<void*>(addr);
+}
+
+/// Frees a block allocated with allocate_aligned
+inline void free_aligned(void* ptr) {
+  if(ptr) std::free(static_cast<void**>(ptr)[-1]);
+}
+
+/// Measures the time spent converting arguments and the total time
+/// of a call. The disabled specialization does nothing and is entirely
+/// optimized out.
+template<bool Enabled>
+class call_timer;
+
+template<>
+class call_timer<false> {
+
+  public:
+
+  void converted() {}
+
+  void finish(call_stats&) {}
+};
+
+template<>
+class call_timer<true> {
+
+  using clock = std::chrono::steady_clock;
+
+  public:
+
+  call_timer()
+  : m_start(clock::now()) {}
+
+  void converted() {
+    m_converted = clock::now();
+  }
+
+  void finish(call_stats& stats) {
+    auto end        = clock::now();
+    uint64_t total  = to_ns(end - m_start);
+    stats.calls         += 1;
+    stats.total_ns      += total;
+    stats.conversion_ns += to_ns(m_converted - m_start);
+    if(total > stats.max_ns) stats.max_ns = total;
+  }
+
+  private:
+
+  template<typename Duration>
+  static uint64_t to_ns(Duration d) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  }
+
+  clock::time_point m_start;
+  clock::time_point m_converted = m_start;
+};
+
+using profiling_enabled = std::integral_constant<bool, MRBIND14_ENABLE_PROFILING>;
+
+/// Writes the profiles as an aligned text table
+inline void write_profile_table(std::ostream& os, const std::vector<function_profile>& profiles) {
+  os << std::left  << std::setw(32) << "function"
+     << std::right << std::setw(12) << "calls"
+     << std::setw(16) << "total (ns)"
+     << std::setw(16) << "mean (ns)"
+     << std::setw(16) << "max (ns)"
+     << std::setw(16) << "convert (ns)" << '\n';
+  for(const auto& p : profiles) {
+    os << std::left  << std::setw(32) << p.name
+       << std::right << std::setw(12) << p.calls
+       << std::setw(16) << p.total_ns
+       << std::setw(16) << (p.calls ? p.total_ns / p.calls : 0)
+       << std::setw(16) << p.max_ns
+       << std::setw(16) << p.conversion_ns << '\n';
+  }
+}
+
+/// Writes the profiles as a JSON array of objects
+inline void write_profile_json(std::ostream& os, const std::vector<function_profile>& profiles) {
+  os << '[';
+  bool first = true;
+  for(const auto& p : profiles) {
+    if(!first) os << ',';
+    first = false;
+    os << "{\"name\":\"";
+    for(char c : p.name) {
+      if(c == '"' || c == '\\') os << '\\';
+      os << c;
+    }
+    os << "\",\"calls\":"         << p.calls
+       << ",\"total_ns\":"        << p.total_ns
+       << ",\"max_ns\":"          << p.max_ns
+       << ",\"conversion_ns\":"   << p.conversion_ns << '}';
+  }
+  os << ']';
+}
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
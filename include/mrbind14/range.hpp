@@ -0,0 +1,405 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_RANGE_H_
+#define MRBIND14_RANGE_H_
+
+#include <mrbind14/type_binder.hpp>
+#include <mrbind14/state.hpp>
+#include <mrbind14/gc.hpp>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mrbind14 {
+
+namespace detail {
+
+/// Number of items converted at once by CppRange#each before
+/// yielding them, and default batch size of CppRange#each_batch
+constexpr size_t range_batch_size = 64;
+
+/// Position in a range, created for each iteration
+class range_cursor {
+
+  public:
+
+  virtual ~range_cursor() = default;
+
+  /// Converts up to n items into out, returning the number of items
+  /// converted (0 once the range is exhausted)
+  virtual size_t next(mrb_state* mrb, mrb_value* out, size_t n) = 0;
+
+  /// Called with the number of items of the last call to next that
+  /// are about to be handed to Ruby, before yielding them, so that an
+  /// iteration stopped early knows where it stopped without relying on
+  /// C++ destructors (see range_each)
+  virtual void consumed(size_t n) {}
+};
+
+/// Interface of the objects wrapped by CppRange proxies
+class abstract_range {
+
+  public:
+
+  virtual ~abstract_range() = default;
+
+  virtual std::unique_ptr<range_cursor> cursor() = 0;
+};
+
+template<typename Iterator>
+class iterator_cursor : public range_cursor {
+
+  public:
+
+  iterator_cursor(Iterator begin, Iterator end)
+  : m_pos(std::move(begin)), m_end(std::move(end)) {}
+
+  size_t next(mrb_state* mrb, mrb_value* out, size_t n) override {
+    size_t i = 0;
+    for(; i < n && m_pos != m_end; ++i, ++m_pos)
+      out[i] = cpp_to_mrb(mrb, *m_pos);
+    return i;
+  }
+
+  private:
+
+  Iterator m_pos;
+  Iterator m_end;
+};
+
+/// Ranges over iterators restart from begin at each iteration
+template<typename Iterator>
+class iterator_range_impl : public abstract_range {
+
+  public:
+
+  iterator_range_impl(Iterator begin, Iterator end)
+  : m_begin(std::move(begin)), m_end(std::move(end)) {}
+
+  std::unique_ptr<range_cursor> cursor() override {
+    return std::make_unique<iterator_cursor<Iterator>>(m_begin, m_end);
+  }
+
+  private:
+
+  Iterator m_begin;
+  Iterator m_end;
+};
+
+/// Ranges owning a container (or any object with begin and end)
+template<typename Container>
+class container_range_impl : public abstract_range {
+
+  public:
+
+  explicit container_range_impl(Container c)
+  : m_container(std::move(c)) {}
+
+  std::unique_ptr<range_cursor> cursor() override {
+    using std::begin;
+    using std::end;
+    using iterator = decltype(begin(m_container));
+    return std::make_unique<iterator_cursor<iterator>>(begin(m_container), end(m_container));
+  }
+
+  private:
+
+  Container m_container;
+};
+
+/// Generators are single-pass: each iteration resumes where the
+/// previous one stopped, and a finished generator stays finished.
+/// Items are pulled by batches into a buffer, from which only the
+/// items actually yielded are removed, so that stopping an iteration
+/// early does not lose the rest of the batch.
+template<typename T, typename Generator>
+class generator_impl : public abstract_range {
+
+  class cursor_type : public range_cursor {
+
+    public:
+
+    explicit cursor_type(generator_impl* owner)
+    : m_owner(owner) {}
+
+    size_t next(mrb_state* mrb, mrb_value* out, size_t n) override {
+      auto& buffer = m_owner->m_buffer;
+      auto& pos    = m_owner->m_pos;
+      if(pos == buffer.size()) m_owner->refill(n);
+      size_t count = std::min(n, buffer.size() - pos);
+      for(size_t i = 0; i < count; i++)
+        out[i] = cpp_to_mrb(mrb, buffer[pos + i]);
+      return count;
+    }
+
+    void consumed(size_t n) override {
+      m_owner->m_pos += n;
+    }
+
+    private:
+
+    generator_impl* m_owner;
+  };
+
+  public:
+
+  explicit generator_impl(Generator next)
+  : m_next(std::move(next)) {}
+
+  std::unique_ptr<range_cursor> cursor() override {
+    return std::make_unique<cursor_type>(this);
+  }
+
+  private:
+
+  void refill(size_t n) {
+    m_buffer.clear();
+    m_pos = 0;
+    T item;
+    while(m_buffer.size() < n && !m_done) {
+      if(m_next(item)) m_buffer.push_back(std::move(item));
+      else m_done = true;
+    }
+  }
+
+  Generator      m_next;
+  std::vector<T> m_buffer;
+  size_t         m_pos  = 0;
+  bool           m_done = false;
+};
+
+} // namespace detail
+
+/// The range class is a lazy sequence of C++ values. Returned by a
+/// bound function, it becomes a CppRange object: an Enumerable whose
+/// each method pulls items from C++ on demand, so that Ruby code can
+/// walk arbitrarily long sequences in constant memory and stop early
+/// (e.g. with first, take_while or break). Ranges passed back to a
+/// bound function are shared, not copied.
+class range {
+
+  public:
+
+  range() = default;
+
+  explicit range(std::shared_ptr<detail::abstract_range> impl)
+  : m_impl(std::move(impl)) {}
+
+  detail::abstract_range* impl() const {
+    return m_impl.get();
+  }
+
+  const std::shared_ptr<detail::abstract_range>& shared_impl() const {
+    return m_impl;
+  }
+
+  explicit operator bool() const {
+    return m_impl != nullptr;
+  }
+
+  private:
+
+  std::shared_ptr<detail::abstract_range> m_impl;
+};
+
+/// Creates a range over [begin, end). The iterators must remain
+/// valid for as long as the Ruby object is used.
+template<typename Iterator>
+range make_range(Iterator begin, Iterator end) {
+  return range(std::make_shared<detail::iterator_range_impl<Iterator>>(
+        std::move(begin), std::move(end)));
+}
+
+/// Creates a range owning the container (moved in, or copied if it is
+/// an lvalue). Any object with begin and end can be used, including
+/// lazily computed views.
+template<typename Container>
+range make_range(Container&& c) {
+  using container_type = std::decay_t<Container>;
+  return range(std::make_shared<detail::container_range_impl<container_type>>(
+        std::forward<Container>(c)));
+}
+
+/// Creates a range from a generator, i.e. a callable taking a T& that
+/// it fills with the next item, returning false when there are none.
+template<typename T, typename Generator>
+range make_generator(Generator&& next) {
+  using generator_type = std::decay_t<Generator>;
+  return range(std::make_shared<detail::generator_impl<T, generator_type>>(
+        std::forward<Generator>(next)));
+}
+
+namespace detail {
+
+/// State of an iteration over a CppRange. It is owned by a Ruby object
+/// rather than by the C++ frame of each, so that it is freed by the GC
+/// however the iteration ends.
+struct range_iteration {
+  std::shared_ptr<abstract_range> range;
+  std::unique_ptr<range_cursor>   cursor;
+};
+
+/// Returns the mrb_data_type of CppRange objects
+MRBIND14_INLINE const mrb_data_type* range_data_type();
+
+/// Returns the CppRange class of the state, creating it if needed
+MRBIND14_INLINE struct RClass* range_class(mrb_state* mrb);
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE void free_range(mrb_state* mrb, void* ptr) {
+  delete static_cast<std::shared_ptr<abstract_range>*>(ptr);
+}
+
+MRBIND14_INLINE const mrb_data_type* range_data_type() {
+  static const mrb_data_type type = { "CppRange", &free_range };
+  return &type;
+}
+
+MRBIND14_INLINE void free_range_iteration(mrb_state* mrb, void* ptr) {
+  delete static_cast<range_iteration*>(ptr);
+}
+
+MRBIND14_INLINE const mrb_data_type* range_iteration_data_type() {
+  static const mrb_data_type type = { "CppRange iteration", &free_range_iteration };
+  return &type;
+}
+
+/// Starts an iteration over the range wrapped by self. The returned
+/// cursor belongs to an object left in the GC arena, which keeps it
+/// alive until the caller restores the arena below its current level.
+MRBIND14_INLINE range_cursor* start_range_iteration(mrb_state* mrb, mrb_value self) {
+  auto ptr = static_cast<std::shared_ptr<abstract_range>*>(
+      mrb_data_get_ptr(mrb, self, range_data_type()));
+  if(!ptr || !*ptr) mrb_raise(mrb, E_TYPE_ERROR, "uninitialized CppRange");
+  struct RData* data = mrb_data_object_alloc(mrb, mrb->object_class, nullptr, range_iteration_data_type());
+  auto iteration = new range_iteration{*ptr, nullptr};
+  data->data = iteration;
+  iteration->cursor = iteration->range->cursor();
+  return iteration->cursor.get();
+}
+
+/// Returns an Enumerator for the method if mruby has them
+MRBIND14_INLINE mrb_value range_enumerator(mrb_state* mrb, mrb_value self, const char* method) {
+  mrb_sym to_enum = mrb_intern_lit(mrb, "to_enum");
+  if(!mrb_respond_to(mrb, self, to_enum))
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "no block given");
+  mrb_value sym = mrb_symbol_value(mrb_intern_cstr(mrb, method));
+  return mrb_funcall_argv(mrb, self, to_enum, 1, &sym);
+}
+
+// A break, return or throw in the block (including the ones used by
+// Enumerable#first or take_while) leaves each and each_batch without
+// running C++ destructors unless mruby is built with C++ exceptions.
+// Their frames therefore only hold trivially destructible values: the
+// cursor belongs to a Ruby object, the arena is saved and restored by
+// hand, and items are marked as consumed before being yielded.
+
+/// Items are converted by batches, then yielded one by one, the arena
+/// being restored after each batch.
+MRBIND14_INLINE mrb_value range_each(mrb_state* mrb, mrb_value self) {
+  mrb_value block;
+  mrb_get_args(mrb, "&", &block);
+  if(mrb_nil_p(block)) return range_enumerator(mrb, self, "each");
+  range_cursor* cursor = start_range_iteration(mrb, self);
+  mrb_value items[range_batch_size];
+  int ai = mrb_gc_arena_save(mrb);
+  for(;;) {
+    size_t n = cursor->next(mrb, items, range_batch_size);
+    if(n == 0) break;
+    for(size_t i = 0; i < n; i++) {
+      cursor->consumed(1);
+      mrb_yield(mrb, block, items[i]);
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return self;
+}
+
+/// Yields Arrays of up to batch_size items, so that Ruby code that
+/// processes whole batches crosses into C++ once per batch
+MRBIND14_INLINE mrb_value range_each_batch(mrb_state* mrb, mrb_value self) {
+  mrb_int batch_size = range_batch_size;
+  mrb_value block;
+  mrb_get_args(mrb, "|i&", &batch_size, &block);
+  if(batch_size <= 0)
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid batch size");
+  if(mrb_nil_p(block)) return range_enumerator(mrb, self, "each_batch");
+  range_cursor* cursor = start_range_iteration(mrb, self);
+  mrb_value items[range_batch_size];
+  int ai = mrb_gc_arena_save(mrb);
+  for(;;) {
+    mrb_value batch = mrb_ary_new_capa(mrb, std::min<mrb_int>(batch_size, range_batch_size));
+    while(RARRAY_LEN(batch) < batch_size) {
+      size_t wanted = std::min<size_t>(batch_size - RARRAY_LEN(batch), range_batch_size);
+      size_t n = cursor->next(mrb, items, wanted);
+      if(n == 0) break;
+      cursor->consumed(n);
+      for(size_t i = 0; i < n; i++) mrb_ary_push(mrb, batch, items[i]);
+    }
+    if(RARRAY_LEN(batch) == 0) break;
+    mrb_yield(mrb, block, batch);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return self;
+}
+
+MRBIND14_INLINE struct RClass* range_class(mrb_state* mrb) {
+  auto& state = get_state_data(mrb);
+  if(state.range_class) return state.range_class;
+  struct RClass* cls = mrb_define_class(mrb, "CppRange", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+  mrb_undef_class_method(mrb, cls, "new");
+  mrb_include_module(mrb, cls, mrb_module_get(mrb, "Enumerable"));
+  mrb_define_method(mrb, cls, "each",       range_each,       MRB_ARGS_BLOCK());
+  mrb_define_method(mrb, cls, "each_batch", range_each_batch, MRB_ARGS_OPT(1) | MRB_ARGS_BLOCK());
+  state.range_class = cls;
+  return cls;
+}
+
+#endif
+
+template<>
+struct type_binder<range> {
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, const range& r) {
+    if(!r) return mrb_nil_value();
+    struct RData* data = mrb_data_object_alloc(mrb, range_class(mrb), nullptr, range_data_type());
+    data->data = new std::shared_ptr<abstract_range>(r.shared_impl());
+    return mrb_obj_value(data);
+  }
+
+  static range mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    if(mrb_nil_p(val)) return range();
+    auto ptr = static_cast<std::shared_ptr<abstract_range>*>(
+        mrb_data_get_ptr(mrb, val, range_data_type()));
+    return range(*ptr);
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return mrb_nil_p(val)
+      || (mrb_type(val) == MRB_TT_DATA && DATA_TYPE(val) == range_data_type());
+  }
+};
+
+template<>
+struct static_type_name<range> {
+  static constexpr bool available = true;
+  static constexpr auto name() { return make_static_string("range"); }
+};
+
+} // namespace detail
+
+}
+
+#endif
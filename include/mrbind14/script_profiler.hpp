@@ -0,0 +1,114 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_SCRIPT_PROFILER_H_
+#define MRBIND14_SCRIPT_PROFILER_H_
+
+#include <mruby.h>
+#include <string>
+#include <unordered_map>
+#include <ostream>
+
+#ifdef MRB_ENABLE_DEBUG_HOOK
+#include <mruby/proc.h>
+#include <mruby/debug.h>
+#endif
+
+namespace mrbind14 {
+
+namespace detail {
+
+/// Sampling profiler for Ruby code. It relies on the code fetch hook
+/// of the VM, which is only available when mruby was built with
+/// MRB_ENABLE_DEBUG_HOOK. One sample is taken every m_interval VM
+/// instructions and aggregated as a folded stack (frames separated
+/// by ';'), the format expected by flamegraph tools.
+class script_sampler {
+
+  public:
+
+  bool active() const {
+    return m_active;
+  }
+
+  const std::unordered_map<std::string, uint64_t>& folded_stacks() const {
+    return m_stacks;
+  }
+
+  void reset() {
+    m_stacks.clear();
+  }
+
+  /// Writes one "stack count" line per distinct folded stack
+  void write_folded(std::ostream& os) const {
+    for(const auto& s : m_stacks)
+      os << s.first << ' ' << s.second << '\n';
+  }
+
+#ifdef MRB_ENABLE_DEBUG_HOOK
+  void start(mrb_state* mrb, unsigned interval) {
+    m_interval  = interval ? interval : 1;
+    m_countdown = m_interval;
+    if(m_active) return;
+    m_previous_hook = mrb->code_fetch_hook;
+    mrb->code_fetch_hook = &script_sampler::hook;
+    m_active = true;
+  }
+
+  void stop(mrb_state* mrb) {
+    if(!m_active) return;
+    mrb->code_fetch_hook = m_previous_hook;
+    m_active = false;
+  }
+#endif
+
+  private:
+
+#ifdef MRB_ENABLE_DEBUG_HOOK
+  using hook_type = decltype(mrb_state::code_fetch_hook);
+
+  static void hook(mrb_state* mrb, struct mrb_irep* irep, const mrb_code* pc, mrb_value* regs);
+
+  void sample(mrb_state* mrb, struct mrb_irep* irep, const mrb_code* pc) {
+    m_buffer.clear();
+    auto c = mrb->c;
+    for(auto ci = c->cibase; ci <= c->ci; ++ci) {
+      if(ci != c->cibase) m_buffer += ';';
+      if(ci->mid) {
+        mrb_int len;
+        const char* name = mrb_sym2name_len(mrb, ci->mid, &len);
+        m_buffer.append(name, len);
+      } else {
+        m_buffer += (ci == c->cibase) ? "<main>" : "<block>";
+      }
+    }
+    // innermost location, when debug information is available
+    const char* file = mrb_debug_get_filename(mrb, irep, pc - irep->iseq);
+    int32_t line     = mrb_debug_get_line(mrb, irep, pc - irep->iseq);
+    if(file) {
+      m_buffer += " (";
+      m_buffer += file;
+      m_buffer += ':';
+      m_buffer += std::to_string(line);
+      m_buffer += ')';
+    }
+    m_stacks[m_buffer] += 1;
+  }
+
+  hook_type m_previous_hook = nullptr;
+  unsigned  m_countdown     = 0;
+#endif
+
+  bool        m_active   = false;
+  unsigned    m_interval = 1;
+  std::string m_buffer;
+  std::unordered_map<std::string, uint64_t> m_stacks;
+};
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
@@ -0,0 +1,561 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_SCRIPT_REGISTRY_H_
+#define MRBIND14_SCRIPT_REGISTRY_H_
+
+#include <mrbind14/module.hpp>
+#include <mrbind14/object.hpp>
+#include <mrbind14/exception.hpp>
+#include <mrbind14/mapped_file.hpp>
+#include <mrbind14/gc.hpp>
+#include <mruby.h>
+#include <mruby/compile.h>
+#include <mruby/dump.h>
+#include <mruby/irep.h>
+#include <mruby/proc.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace mrbind14 {
+
+/**
+ * @brief Reload statistics of a script of a script_registry.
+ */
+struct reload_stats {
+  uint64_t reloads          = 0; // number of new versions installed
+  uint64_t failures         = 0; // number of recompilations or loads that failed
+  uint64_t last_latency_ns  = 0; // time from the detection of the last change to its swap
+  uint64_t max_latency_ns   = 0; // maximum of these times
+  uint64_t total_latency_ns = 0; // sum of these times
+  uint64_t last_compile_ns  = 0; // time spent compiling the last version
+
+  /**
+   * @brief Returns the average reload latency, in nanoseconds.
+   */
+  double average_latency_ns() const {
+    return reloads ? static_cast<double>(total_latency_ns) / reloads : 0.0;
+  }
+};
+
+/**
+ * @brief How a script_registry detects changes: inotify on Linux,
+ * falling back to polling if inotify is unavailable, or polling only.
+ */
+enum class watch_mode {
+  automatic,
+  polling
+};
+
+namespace detail {
+
+/// Identity of the content of a file, compared to detect changes
+struct file_signature {
+
+  bool     exists   = false;
+  uint64_t mtime_ns = 0;
+  uint64_t size     = 0;
+  uint64_t inode    = 0;
+
+  static file_signature of(const std::string& path) {
+    file_signature sig;
+    struct stat st;
+    if(::stat(path.c_str(), &st) != 0) return sig;
+    sig.exists   = true;
+#ifdef __linux__
+    sig.mtime_ns = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    sig.mtime_ns = static_cast<uint64_t>(st.st_mtime) * 1000000000;
+#endif
+    sig.size     = static_cast<uint64_t>(st.st_size);
+    sig.inode    = static_cast<uint64_t>(st.st_ino);
+    return sig;
+  }
+
+  bool operator==(const file_signature& other) const {
+    return exists == other.exists && mtime_ns == other.mtime_ns
+        && size == other.size && inode == other.inode;
+  }
+
+  bool operator!=(const file_signature& other) const {
+    return !(*this == other);
+  }
+};
+
+/// Result of the compilation of a script: RITE bytecode, or an error
+struct compiled_script {
+  std::string                           name;
+  std::vector<uint8_t>                  bytecode;
+  std::string                           error;
+  std::chrono::steady_clock::time_point detected;
+  uint64_t                              compile_ns = 0;
+};
+
+/// Compiles scripts into bytecode with a private, core-only mruby
+/// state, so that compilation does not need the interpreter running
+/// the scripts. The bytecode is loaded into the interpreter with
+/// mrb_read_irep, which is much cheaper than parsing.
+class script_compiler {
+
+  public:
+
+  script_compiler()
+  : m_mrb(mrb_open_core(mrb_default_allocf, nullptr)) {
+    if(!m_mrb) throw std::runtime_error("Could not create the script compiler");
+  }
+
+  script_compiler(const script_compiler&) = delete;
+
+  script_compiler& operator=(const script_compiler&) = delete;
+
+  ~script_compiler() {
+    mrb_close(m_mrb);
+  }
+
+  void compile(const std::string& path, compiled_script& result) {
+    auto start = std::chrono::steady_clock::now();
+    result.bytecode.clear();
+    result.error.clear();
+    try {
+      mapped_file file(path);
+      compile(path, file.data(), file.size(), result);
+    } catch(const std::exception& e) {
+      result.error = e.what();
+    }
+    result.compile_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  private:
+
+  void compile(const std::string& path, const char* code, size_t size, compiled_script& result) {
+    mrbc_context* cxt = mrbc_context_new(m_mrb);
+    cxt->capture_errors = TRUE;
+    mrbc_filename(m_mrb, cxt, path.c_str());
+    int ai = mrb_gc_arena_save(m_mrb);
+    struct mrb_parser_state* p = mrb_parse_nstring(m_mrb, code, size, cxt);
+    if(!p) {
+      result.error = path + ": could not parse";
+    } else if(p->nerr > 0) {
+      result.error = path + ":" + std::to_string(p->error_buffer[0].lineno)
+                   + ": " + p->error_buffer[0].message;
+    } else {
+      struct RProc* proc = mrb_generate_code(m_mrb, p);
+      uint8_t* bin  = nullptr;
+      size_t   len  = 0;
+      if(!proc) {
+        result.error = path + ": code generation failed";
+      } else if(mrb_dump_irep(m_mrb, proc->body.irep, DUMP_DEBUG_INFO, &bin, &len) != MRB_DUMP_OK) {
+        result.error = path + ": could not dump the bytecode";
+      } else {
+        result.bytecode.assign(bin, bin + len);
+      }
+      mrb_free(m_mrb, bin);
+    }
+    if(p) mrb_parser_free(p);
+    mrb_gc_arena_restore(m_mrb, ai);
+    mrbc_context_free(m_mrb, cxt);
+    mrb_full_gc(m_mrb);
+  }
+
+  mrb_state* m_mrb;
+};
+
+/// Background thread watching the files of a script_registry and
+/// recompiling them when they change. With inotify, the watcher sleeps
+/// until a watched directory changes; otherwise it checks the files at
+/// each interval. Either way, files are compared with their signature,
+/// so several events for the same write trigger a single compilation.
+class script_watcher {
+
+  struct watched_file {
+    std::string    name;
+    std::string    path;
+    file_signature signature;
+  };
+
+  public:
+
+  script_watcher(std::chrono::milliseconds interval, watch_mode mode)
+  : m_interval(interval) {
+#ifdef __linux__
+    if(mode == watch_mode::automatic)
+      m_inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    m_thread = std::thread([this]() { run(); });
+  }
+
+  script_watcher(const script_watcher&) = delete;
+
+  script_watcher& operator=(const script_watcher&) = delete;
+
+  ~script_watcher() {
+    m_stop = true;
+    m_thread.join();
+#ifdef __linux__
+    if(m_inotify >= 0) ::close(m_inotify);
+#endif
+  }
+
+  bool uses_inotify() const {
+    return m_inotify >= 0 && !m_polling;
+  }
+
+  /// Compiles a file in the calling thread
+  void compile(const std::string& path, compiled_script& result) {
+    std::lock_guard<std::mutex> lock(m_compiler_mutex);
+    m_compiler.compile(path, result);
+  }
+
+  /// Starts watching a file, signature being that of the compiled version
+  void watch(const std::string& name, const std::string& path, const file_signature& signature) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+#ifdef __linux__
+    if(m_inotify >= 0) {
+      auto slash = path.rfind('/');
+      std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+      if(::inotify_add_watch(m_inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0)
+        m_polling = true;
+    }
+#endif
+    for(auto& f : m_files) {
+      if(f.name == name) {
+        f.path      = path;
+        f.signature = signature;
+        return;
+      }
+    }
+    m_files.push_back({ name, path, signature });
+  }
+
+  void unwatch(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto it = m_files.begin(); it != m_files.end(); ++it) {
+      if(it->name == name) {
+        m_files.erase(it);
+        return;
+      }
+    }
+  }
+
+  bool has_results() const {
+    return m_has_results.load(std::memory_order_acquire);
+  }
+
+  /// Returns the compilations done since the last call, oldest first
+  std::vector<compiled_script> take_results() {
+    std::vector<compiled_script> results;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    results.swap(m_results);
+    m_has_results.store(false, std::memory_order_release);
+    return results;
+  }
+
+  private:
+
+  void run() {
+    while(!m_stop) {
+      if(wait()) check();
+    }
+  }
+
+  /// Waits for at most one interval, returning whether files may have changed
+  bool wait() {
+#ifdef __linux__
+    if(uses_inotify()) {
+      struct pollfd pfd = { m_inotify, POLLIN, 0 };
+      if(::poll(&pfd, 1, static_cast<int>(m_interval.count())) <= 0) return false;
+      char buffer[4096];
+      while(::read(m_inotify, buffer, sizeof(buffer)) > 0) {}
+      return true;
+    }
+#endif
+    std::this_thread::sleep_for(m_interval);
+    return true;
+  }
+
+  void check() {
+    std::vector<watched_file> files;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      files = m_files;
+    }
+    for(auto& f : files) {
+      auto signature = file_signature::of(f.path);
+      if(signature == f.signature || !signature.exists) continue;
+      compiled_script result;
+      result.name     = f.name;
+      result.detected = std::chrono::steady_clock::now();
+      compile(f.path, result);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for(auto& w : m_files) {
+        if(w.name == f.name && w.path == f.path) {
+          w.signature = signature;
+          m_results.push_back(std::move(result));
+          m_has_results.store(true, std::memory_order_release);
+          break;
+        }
+      }
+    }
+  }
+
+  std::chrono::milliseconds    m_interval;
+  int                          m_inotify = -1;
+  std::atomic<bool>            m_polling{false};
+  std::atomic<bool>            m_stop{false};
+  std::atomic<bool>            m_has_results{false};
+  std::mutex                   m_mutex;
+  std::vector<watched_file>    m_files;
+  std::vector<compiled_script> m_results;
+  std::mutex                   m_compiler_mutex;
+  script_compiler              m_compiler;
+  std::thread                  m_thread;
+};
+
+} // namespace detail
+
+/**
+ * @brief The script_registry class keeps compiled scripts up to date
+ * with their files, so that they can be changed without restarting
+ * the interpreter and losing its state:
+ *
+ *   mrbind14::script_registry scripts(mruby);
+ *   scripts.add("rules", "rules.rb");
+ *   ...
+ *   scripts.execute("rules"); // runs the latest version of rules.rb
+ *
+ * A background thread watches the files (with inotify on Linux, or by
+ * polling them) and recompiles them when they change, in a separate
+ * mruby state. New versions are installed in the interpreter by update,
+ * which execute and get call first, by swapping the proc of the script:
+ * a script being executed when it is swapped (e.g. by a bound function
+ * it calls) runs to completion with the version it started with. A new
+ * version that fails to compile is reported by last_error and leaves
+ * the current version in place.
+ *
+ * Apart from the background thread, the registry must only be used by
+ * the thread using its interpreter, and must be destroyed before it.
+ */
+class script_registry {
+
+  struct script {
+    std::string  path;
+    mrb_value    proc = mrb_nil_value();
+    uint64_t     version = 0;
+    reload_stats stats;
+    std::string  error;
+  };
+
+  public:
+
+  /**
+   * @brief Creates a registry for the interpreter owning the module.
+   *
+   * @param mod Module (or interpreter) of the interpreter.
+   * @param interval Interval between checks when polling, and maximum
+   * time the watcher takes to notice that the registry is destroyed.
+   * @param mode Whether to use inotify when available.
+   */
+  explicit script_registry(const module& mod,
+                           std::chrono::milliseconds interval = std::chrono::milliseconds(100),
+                           watch_mode mode = watch_mode::automatic)
+  : m_mrb(mod.mrb())
+  , m_watcher(interval, mode) {}
+
+  script_registry(const script_registry&) = delete;
+
+  script_registry& operator=(const script_registry&) = delete;
+
+  ~script_registry() {
+    for(auto& s : m_scripts) mrb_gc_unregister(m_mrb, s.second.proc);
+  }
+
+  /**
+   * @brief Compiles the file and starts watching it. Adding a name
+   * again replaces its file.
+   *
+   * @param name Name of the script in the registry.
+   * @param path Path to the file.
+   *
+   * @throw std::runtime_error if the file cannot be compiled.
+   */
+  void add(const std::string& name, const std::string& path) {
+    auto signature = detail::file_signature::of(path);
+    detail::compiled_script compiled;
+    m_watcher.compile(path, compiled);
+    if(!compiled.error.empty()) throw std::runtime_error(compiled.error);
+    // The script enters the registry only once installed, so that a
+    // failure leaves the registry unchanged
+    script s;
+    auto it = m_scripts.find(name);
+    if(it != m_scripts.end()) s = it->second;
+    s.path = path;
+    s.error.clear();
+    install(s, compiled.bytecode);
+    m_scripts[name] = std::move(s);
+    m_watcher.watch(name, path, signature);
+  }
+
+  /**
+   * @brief Removes a script from the registry.
+   */
+  void remove(const std::string& name) {
+    auto it = m_scripts.find(name);
+    if(it == m_scripts.end()) return;
+    m_watcher.unwatch(name);
+    mrb_gc_unregister(m_mrb, it->second.proc);
+    m_scripts.erase(it);
+  }
+
+  bool contains(const std::string& name) const {
+    return m_scripts.count(name) != 0;
+  }
+
+  /**
+   * @brief Installs the versions compiled since the last update.
+   * Versions that failed to compile or to load are counted as failures
+   * and keep the previous version of their script.
+   *
+   * @return The number of scripts swapped.
+   */
+  size_t update() {
+    if(!m_watcher.has_results()) return 0;
+    size_t swapped = 0;
+    for(auto& compiled : m_watcher.take_results()) {
+      auto it = m_scripts.find(compiled.name);
+      if(it == m_scripts.end()) continue;
+      auto& s = it->second;
+      if(!compiled.error.empty()) {
+        s.stats.failures += 1;
+        s.error = std::move(compiled.error);
+        continue;
+      }
+      // a failure to load one script must not lose the results after it
+      try {
+        install(s, compiled.bytecode);
+      } catch(const std::exception& e) {
+        s.stats.failures += 1;
+        s.error = e.what();
+        continue;
+      }
+      s.error.clear();
+      uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - compiled.detected).count();
+      s.stats.reloads          += 1;
+      s.stats.last_latency_ns   = latency;
+      s.stats.max_latency_ns    = std::max(s.stats.max_latency_ns, latency);
+      s.stats.total_latency_ns += latency;
+      s.stats.last_compile_ns   = compiled.compile_ns;
+      swapped += 1;
+    }
+    return swapped;
+  }
+
+  /**
+   * @brief Returns the proc of the current version of a script.
+   */
+  object get(const std::string& name) {
+    update();
+    return object(m_mrb, find(name).proc);
+  }
+
+  /**
+   * @brief Executes the current version of a script.
+   *
+   * @return The value returned by the script.
+   */
+  object execute(const std::string& name) {
+    update();
+    mrb_value proc = find(name).proc;
+    auto val = mrb_top_run(m_mrb, mrb_proc_ptr(proc), mrb_top_self(m_mrb), 0);
+    if(m_mrb->exc) {
+      // the registry stays usable after an error
+      mrb_value exc = mrb_obj_value(m_mrb->exc);
+      m_mrb->exc = nullptr;
+      exception::translate_and_throw_exception(m_mrb, exc);
+    }
+    return object(m_mrb, val);
+  }
+
+  /**
+   * @brief Returns the version of a script, starting at 1 and
+   * incremented each time it is swapped.
+   */
+  uint64_t version(const std::string& name) const {
+    return find(name).version;
+  }
+
+  /**
+   * @brief Returns the reload statistics of a script.
+   */
+  const reload_stats& stats(const std::string& name) const {
+    return find(name).stats;
+  }
+
+  /**
+   * @brief Returns the error of the last compilation of a script,
+   * or an empty string if it succeeded.
+   */
+  const std::string& last_error(const std::string& name) const {
+    return find(name).error;
+  }
+
+  /**
+   * @brief Returns whether changes are detected with inotify.
+   */
+  bool uses_inotify() const {
+    return m_watcher.uses_inotify();
+  }
+
+  private:
+
+  const script& find(const std::string& name) const {
+    auto it = m_scripts.find(name);
+    if(it == m_scripts.end()) throw std::out_of_range("No script named " + name);
+    return it->second;
+  }
+
+  script& find(const std::string& name) {
+    return const_cast<script&>(static_cast<const script_registry*>(this)->find(name));
+  }
+
+  /// Loads the bytecode and makes it the current version of the script.
+  /// The previous proc is no longer registered, but stays alive as
+  /// long as it is being executed.
+  void install(script& s, const std::vector<uint8_t>& bytecode) {
+    gc_arena_scope arena(m_mrb);
+    mrb_irep* irep = mrb_read_irep(m_mrb, bytecode.data());
+    if(!irep) throw std::runtime_error("Could not load the bytecode of " + s.path);
+    struct RProc* proc = mrb_proc_new(m_mrb, irep);
+    mrb_irep_decref(m_mrb, irep);
+    MRB_PROC_SET_TARGET_CLASS(proc, m_mrb->object_class);
+    mrb_value value = mrb_obj_value(proc);
+    mrb_gc_register(m_mrb, value);
+    if(!mrb_nil_p(s.proc)) mrb_gc_unregister(m_mrb, s.proc);
+    s.proc     = value;
+    s.version += 1;
+  }
+
+  mrb_state*                    m_mrb;
+  std::map<std::string, script> m_scripts;
+  detail::script_watcher        m_watcher;
+};
+
+}
+
+#endif
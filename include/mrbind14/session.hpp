@@ -0,0 +1,157 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_SESSION_H_
+#define MRBIND14_SESSION_H_
+
+#include <mrbind14/module.hpp>
+#include <mrbind14/object.hpp>
+#include <mrbind14/exception.hpp>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/compile.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+namespace mrbind14 {
+
+/**
+ * @brief Incremental evaluation session, in the manner of mirb: snippets
+ * evaluated in a session see the local variables defined by the previous
+ * ones. The session keeps its own compile context (with keep_lv and
+ * capture_errors), so the local variable table is carried from one
+ * snippet to the next instead of being rebuilt, and syntax errors are
+ * reported as exceptions with their line number.
+ *
+ *   mrbind14::session repl(mruby);
+ *   repl.evaluate("x = 40");
+ *   repl.evaluate("x + 2"); // 42
+ *
+ * Snippets must be evaluated from the top level (not from within
+ * a bound function), and the session must be destroyed before its
+ * interpreter. Other scripts executed by the interpreter between two
+ * evaluations do not affect the session's local variables.
+ */
+class session {
+
+    public:
+
+    /**
+     * @brief Creates a session for the interpreter owning the module.
+     */
+    explicit session(const module& mod)
+    : m_mrb(mod.mrb()) {
+        m_context = mrbc_context_new(m_mrb);
+        m_context->capture_errors = TRUE;
+        m_context->keep_lv = TRUE;
+        mrbc_filename(m_mrb, m_context, "(session)");
+        m_locals = mrb_ary_new(m_mrb);
+        mrb_gc_register(m_mrb, m_locals);
+    }
+
+    session(const session&) = delete;
+
+    session& operator=(const session&) = delete;
+
+    ~session() {
+        mrb_gc_unregister(m_mrb, m_locals);
+        mrbc_context_free(m_mrb, m_context);
+    }
+
+    /**
+     * @brief Evaluates a null-terminated snippet.
+     */
+    object evaluate(const char* code) {
+        return evaluate(code, strlen(code));
+    }
+
+#if __cplusplus >= 201703L
+    /**
+     * @brief Evaluates a snippet.
+     */
+    object evaluate(std::string_view code) {
+        return evaluate(code.data(), code.size());
+    }
+#endif
+
+    /**
+     * @brief Evaluates a snippet of the given size.
+     *
+     * @return The value of the last expression of the snippet.
+     */
+    object evaluate(const char* code, size_t size) {
+        restore_locals();
+        auto val = mrb_load_nstring_cxt(m_mrb, code, size, m_context);
+        save_locals();
+        m_evaluations += 1;
+        if(m_mrb->exc) {
+            // the session stays usable after an error
+            mrb_value exc = mrb_obj_value(m_mrb->exc);
+            m_mrb->exc = nullptr;
+            exception::translate_and_throw_exception(m_mrb, exc);
+        }
+        return object(m_mrb, val);
+    }
+
+    /**
+     * @brief Returns the names of the local variables defined so far.
+     */
+    std::vector<std::string> local_variables() const {
+        std::vector<std::string> result;
+        for(int i = 0; i < m_context->slen; i++)
+            if(m_context->syms[i]) result.push_back(mrb_sym2name(m_mrb, m_context->syms[i]));
+        return result;
+    }
+
+    /**
+     * @brief Returns the number of snippets evaluated.
+     */
+    size_t evaluations() const {
+        return m_evaluations;
+    }
+
+    /**
+     * @brief Forgets all the local variables.
+     */
+    void reset() {
+        mrb_free(m_mrb, m_context->syms);
+        m_context->syms = nullptr;
+        m_context->slen = 0;
+        mrb_ary_clear(m_mrb, m_locals);
+    }
+
+    private:
+
+    // Local variables live in the registers of the top-level frame, right
+    // after self. Their values are saved in a GC-registered array between
+    // evaluations, since the registers are shared with other scripts.
+
+    void restore_locals() {
+        mrb_value* regs = m_mrb->c->stbase;
+        mrb_int n = RARRAY_LEN(m_locals);
+        if(n >= m_mrb->c->stend - regs) n = m_mrb->c->stend - regs - 1;
+        for(mrb_int i = 0; i < n; i++)
+            regs[i+1] = mrb_ary_ref(m_mrb, m_locals, i);
+    }
+
+    void save_locals() {
+        mrb_value* regs = m_mrb->c->stbase;
+        for(int i = 0; i < m_context->slen; i++)
+            mrb_ary_set(m_mrb, m_locals, i, regs[i+1]);
+    }
+
+    mrb_state*    m_mrb;
+    mrbc_context* m_context;
+    mrb_value     m_locals;
+    size_t        m_evaluations = 0;
+};
+
+}
+
+#endif
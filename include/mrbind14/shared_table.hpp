@@ -0,0 +1,234 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_SHARED_TABLE_H_
+#define MRBIND14_SHARED_TABLE_H_
+
+#include <mrbind14/module.hpp>
+#include <mrbind14/state.hpp>
+#include <mrbind14/type_binder.hpp>
+#include <mrbind14/gc.hpp>
+#include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mrbind14 {
+
+namespace detail {
+
+/// Lookup into the containers that can be shared with shared tables.
+/// Associative containers (std::map, std::unordered_map, ...) are
+/// searched by key, vectors of pairs are expected to be sorted by key
+/// and are searched by binary search, other vectors are indexed.
+template<typename Container, typename Enable = void>
+struct table_traits {
+
+  using key_type    = typename Container::key_type;
+  using mapped_type = typename Container::mapped_type;
+
+  static const mapped_type* find(const Container& c, const key_type& key) {
+    auto it = c.find(key);
+    return it == c.end() ? nullptr : &it->second;
+  }
+
+  template<typename F>
+  static void each(const Container& c, F&& f) {
+    for(const auto& e : c) f(e.first, e.second);
+  }
+};
+
+template<typename K, typename V, typename A>
+struct table_traits<std::vector<std::pair<K, V>, A>> {
+
+  using key_type    = K;
+  using mapped_type = V;
+
+  static const mapped_type* find(const std::vector<std::pair<K, V>, A>& c, const key_type& key) {
+    auto it = std::lower_bound(c.begin(), c.end(), key,
+        [](const std::pair<K, V>& e, const K& k) { return e.first < k; });
+    return it == c.end() || key < it->first ? nullptr : &it->second;
+  }
+
+  template<typename F>
+  static void each(const std::vector<std::pair<K, V>, A>& c, F&& f) {
+    for(const auto& e : c) f(e.first, e.second);
+  }
+};
+
+template<typename T, typename A>
+struct table_traits<std::vector<T, A>> {
+
+  using key_type    = mrb_int;
+  using mapped_type = T;
+
+  static const mapped_type* find(const std::vector<T, A>& c, key_type index) {
+    if(index < 0 || static_cast<size_t>(index) >= c.size()) return nullptr;
+    return &c[index];
+  }
+
+  template<typename F>
+  static void each(const std::vector<T, A>& c, F&& f) {
+    for(size_t i = 0; i < c.size(); i++) f(static_cast<key_type>(i), c[i]);
+  }
+};
+
+/// Interface of the objects wrapped by SharedTable proxies
+class abstract_shared_table {
+
+  public:
+
+  virtual ~abstract_shared_table() = default;
+
+  /// Returns the value associated with the key, or sets found to false
+  virtual mrb_value get(mrb_state* mrb, mrb_value key, bool& found) const = 0;
+
+  /// Yields each key and value to the block
+  virtual void each(mrb_state* mrb, mrb_value block) const = 0;
+
+  virtual size_t size() const = 0;
+};
+
+/// Each interpreter gets its own shared_table_impl, holding a reference
+/// to the process-wide container: lookups only read the container, so
+/// they need no locking.
+template<typename Container>
+class shared_table_impl : public abstract_shared_table {
+
+  using traits      = table_traits<Container>;
+  using key_type    = typename traits::key_type;
+
+  public:
+
+  explicit shared_table_impl(std::shared_ptr<const Container> data)
+  : m_data(std::move(data)) {}
+
+  mrb_value get(mrb_state* mrb, mrb_value key, bool& found) const override {
+    found = false;
+    if(!check_type<key_type>(mrb, key)) return mrb_nil_value();
+    auto value = traits::find(*m_data, mrb_to_cpp<key_type>(mrb, key));
+    if(!value) return mrb_nil_value();
+    found = true;
+    return cpp_to_mrb(mrb, *value);
+  }
+
+  void each(mrb_state* mrb, mrb_value block) const override {
+    traits::each(*m_data, [mrb, block](const key_type& k, const typename traits::mapped_type& v) {
+      gc_arena_scope arena(mrb);
+      mrb_value args[] = { cpp_to_mrb(mrb, k), cpp_to_mrb(mrb, v) };
+      mrb_yield_argv(mrb, block, 2, args);
+    });
+  }
+
+  size_t size() const override {
+    return m_data->size();
+  }
+
+  private:
+
+  std::shared_ptr<const Container> m_data;
+};
+
+/// Returns the mrb_data_type of SharedTable proxies
+MRBIND14_INLINE const mrb_data_type* shared_table_data_type();
+
+/// Returns the SharedTable class of the state, creating it if needed
+MRBIND14_INLINE struct RClass* shared_table_class(mrb_state* mrb);
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE void free_shared_table(mrb_state* mrb, void* ptr) {
+  delete static_cast<abstract_shared_table*>(ptr);
+}
+
+MRBIND14_INLINE const mrb_data_type* shared_table_data_type() {
+  static const mrb_data_type type = { "SharedTable", &free_shared_table };
+  return &type;
+}
+
+MRBIND14_INLINE const abstract_shared_table* get_shared_table(mrb_state* mrb, mrb_value self) {
+  return static_cast<const abstract_shared_table*>(
+      mrb_data_get_ptr(mrb, self, shared_table_data_type()));
+}
+
+MRBIND14_INLINE mrb_value shared_table_get(mrb_state* mrb, mrb_value self) {
+  mrb_value key;
+  mrb_get_args(mrb, "o", &key);
+  bool found;
+  return get_shared_table(mrb, self)->get(mrb, key, found);
+}
+
+MRBIND14_INLINE mrb_value shared_table_fetch(mrb_state* mrb, mrb_value self) {
+  mrb_value key, def;
+  mrb_int argc = mrb_get_args(mrb, "o|o", &key, &def);
+  bool found;
+  mrb_value val = get_shared_table(mrb, self)->get(mrb, key, found);
+  if(found) return val;
+  if(argc > 1) return def;
+  mrb_raisef(mrb, E_KEY_ERROR, "key not found: %S", key);
+  return mrb_nil_value();
+}
+
+MRBIND14_INLINE mrb_value shared_table_has_key(mrb_state* mrb, mrb_value self) {
+  mrb_value key;
+  mrb_get_args(mrb, "o", &key);
+  bool found;
+  get_shared_table(mrb, self)->get(mrb, key, found);
+  return mrb_bool_value(found);
+}
+
+MRBIND14_INLINE mrb_value shared_table_size(mrb_state* mrb, mrb_value self) {
+  return mrb_fixnum_value(get_shared_table(mrb, self)->size());
+}
+
+MRBIND14_INLINE mrb_value shared_table_each(mrb_state* mrb, mrb_value self) {
+  mrb_value block;
+  mrb_get_args(mrb, "&", &block);
+  if(mrb_nil_p(block))
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "no block given");
+  get_shared_table(mrb, self)->each(mrb, block);
+  return self;
+}
+
+MRBIND14_INLINE struct RClass* shared_table_class(mrb_state* mrb) {
+  auto& state = get_state_data(mrb);
+  if(state.shared_table_class) return state.shared_table_class;
+  struct RClass* cls = mrb_define_class(mrb, "SharedTable", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+  mrb_undef_class_method(mrb, cls, "new");
+  mrb_include_module(mrb, cls, mrb_module_get(mrb, "Enumerable"));
+  mrb_define_method(mrb, cls, "[]",       shared_table_get,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "fetch",    shared_table_fetch,   MRB_ARGS_ARG(1, 1));
+  mrb_define_method(mrb, cls, "key?",     shared_table_has_key, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "include?", shared_table_has_key, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "size",     shared_table_size,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, cls, "length",   shared_table_size,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, cls, "each",     shared_table_each,    MRB_ARGS_BLOCK());
+  state.shared_table_class = cls;
+  return cls;
+}
+
+#endif
+
+} // namespace detail
+
+template<typename Container>
+module& module::def_shared_table(const char* name, std::shared_ptr<Container> table) {
+  using impl_type = detail::shared_table_impl<std::remove_const_t<Container>>;
+  struct RClass* cls = detail::shared_table_class(m_mrb);
+  struct RData* data = mrb_data_object_alloc(m_mrb, cls, nullptr, detail::shared_table_data_type());
+  data->data = new impl_type(std::move(table));
+  MRB_SET_FROZEN_FLAG(data);
+  mrb_define_const(m_mrb, m_module, name, mrb_obj_value(data));
+  return *this;
+}
+
+}
+
+#endif
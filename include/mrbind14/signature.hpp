@@ -0,0 +1,208 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_SIGNATURE_H_
+#define MRBIND14_SIGNATURE_H_
+
+#include <mrbind14/type_registry.hpp>
+#include <mrbind14/type_traits.hpp>
+#include <mruby.h>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+namespace mrbind14 {
+
+class object;
+
+namespace detail {
+
+/// Fixed-size string that can be built and concatenated at compile time
+template<size_t N>
+struct static_string {
+
+  constexpr static_string() = default;
+
+  constexpr static_string(const char (&str)[N+1]) {
+    for(size_t i = 0; i < N; i++) data[i] = str[i];
+  }
+
+  constexpr const char* c_str() const {
+    return data;
+  }
+
+  constexpr size_t size() const {
+    return N;
+  }
+
+  char data[N+1] = {};
+};
+
+template<size_t N>
+constexpr static_string<N-1> make_static_string(const char (&str)[N]) {
+  return static_string<N-1>(str);
+}
+
+template<size_t N, size_t M>
+constexpr static_string<N+M> operator+(const static_string<N>& a, const static_string<M>& b) {
+  static_string<N+M> result;
+  for(size_t i = 0; i < N; i++) result.data[i]   = a.data[i];
+  for(size_t i = 0; i < M; i++) result.data[N+i] = b.data[i];
+  return result;
+}
+
+/// Names of the built-in types, known at compile time. Other types
+/// (e.g. bound classes) are named through the per-state registry
+/// (see get_cpp_class_name).
+template<typename T, typename Enable = void>
+struct static_type_name {
+  static constexpr bool available = false;
+};
+
+template<typename T>
+struct static_type_name<T, std::enable_if_t<
+  is_string<T>::value || is_c_style_string<T>::value>> {
+  static constexpr bool available = true;
+  static constexpr auto name() { return make_static_string("string"); }
+};
+
+#if __cplusplus >= 201703L
+template<>
+struct static_type_name<std::string_view> {
+  static constexpr bool available = true;
+  static constexpr auto name() { return make_static_string("string"); }
+};
+#endif
+
+#define MRBIND14_STATIC_TYPE_NAME(Type, Name)                              \
+  template<>                                                               \
+  struct static_type_name<Type> {                                          \
+    static constexpr bool available = true;                                \
+    static constexpr auto name() { return make_static_string(Name); }      \
+  };
+
+MRBIND14_STATIC_TYPE_NAME(void,               "void")
+MRBIND14_STATIC_TYPE_NAME(bool,               "bool")
+MRBIND14_STATIC_TYPE_NAME(char,               "char")
+MRBIND14_STATIC_TYPE_NAME(wchar_t,            "wchar")
+MRBIND14_STATIC_TYPE_NAME(short,              "short")
+MRBIND14_STATIC_TYPE_NAME(int,                "int")
+MRBIND14_STATIC_TYPE_NAME(long,               "long")
+MRBIND14_STATIC_TYPE_NAME(long long,          "long long")
+MRBIND14_STATIC_TYPE_NAME(unsigned char,      "unsigned char")
+MRBIND14_STATIC_TYPE_NAME(unsigned short,     "unsigned short")
+MRBIND14_STATIC_TYPE_NAME(unsigned,           "unsigned")
+MRBIND14_STATIC_TYPE_NAME(unsigned long,      "unsigned long")
+MRBIND14_STATIC_TYPE_NAME(unsigned long long, "unsigned long long")
+MRBIND14_STATIC_TYPE_NAME(float,              "float")
+MRBIND14_STATIC_TYPE_NAME(double,             "double")
+MRBIND14_STATIC_TYPE_NAME(long double,        "long double")
+MRBIND14_STATIC_TYPE_NAME(mrb_value,          "object")
+MRBIND14_STATIC_TYPE_NAME(object,             "object")
+
+#undef MRBIND14_STATIC_TYPE_NAME
+
+/// Storage for the static name of T
+template<typename T>
+struct static_name {
+  using type = decltype(static_type_name<T>::name());
+  static constexpr type value = static_type_name<T>::name();
+};
+
+template<typename T>
+constexpr typename static_name<T>::type static_name<T>::value;
+
+template<typename T>
+const char* type_name(mrb_state* mrb, std::true_type) {
+  return static_name<std::decay_t<T>>::value.c_str();
+}
+
+template<typename T>
+const char* type_name(mrb_state* mrb, std::false_type) {
+  return find_cpp_class_name<T>(mrb);
+}
+
+/// Returns the name of T in error messages and signatures, without
+/// allocating for built-in types and for types already named in mrb
+template<typename T>
+const char* type_name(mrb_state* mrb) {
+  using available = std::integral_constant<bool, static_type_name<std::decay_t<T>>::available>;
+  return type_name<T>(mrb, available());
+}
+
+/// Checks if all the types have a static name
+template<typename ... T>
+struct all_static_names;
+
+template<>
+struct all_static_names<> : std::true_type {};
+
+template<typename T1, typename ... T>
+struct all_static_names<T1, T...> : std::integral_constant<bool,
+  static_type_name<std::decay_t<T1>>::available && all_static_names<T...>::value> {};
+
+/// Comma-separated list of the names of the types
+template<typename ... T>
+struct static_type_list;
+
+template<>
+struct static_type_list<> {
+  static constexpr auto value() { return make_static_string(""); }
+};
+
+template<typename T>
+struct static_type_list<T> {
+  static constexpr auto value() { return static_type_name<std::decay_t<T>>::name(); }
+};
+
+template<typename T1, typename T2, typename ... T>
+struct static_type_list<T1, T2, T...> {
+  static constexpr auto value() {
+    return static_type_name<std::decay_t<T1>>::name()
+         + make_static_string(", ")
+         + static_type_list<T2, T...>::value();
+  }
+};
+
+/// Signature "(P1, P2, ...) -> R" of a function whose parameter and
+/// return types all have a static name, built at compile time
+template<typename R, typename ... P>
+constexpr auto make_static_signature() {
+  return make_static_string("(") + static_type_list<P...>::value()
+       + make_static_string(") -> ") + static_type_name<std::decay_t<R>>::name();
+}
+
+template<typename R, typename ... P>
+struct static_signature {
+  using type = decltype(make_static_signature<R, P...>());
+  static constexpr type value = make_static_signature<R, P...>();
+};
+
+template<typename R, typename ... P>
+constexpr typename static_signature<R, P...>::type static_signature<R, P...>::value;
+
+/// Builds the signature of a function at run time, for functions
+/// involving types named through the per-state registry
+template<typename R, typename ... P>
+std::string make_signature(mrb_state* mrb) {
+  const char* names[] = { type_name<P>(mrb)..., nullptr };
+  std::string result = "(";
+  for(size_t i = 0; i < sizeof...(P); i++) {
+    if(i != 0) result += ", ";
+    result += names[i];
+  }
+  result += ") -> ";
+  result += type_name<R>(mrb);
+  return result;
+}
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
@@ -0,0 +1,128 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_STATE_H_
+#define MRBIND14_STATE_H_
+
+#include <mrbind14/config.hpp>
+#include <mrbind14/script_profiler.hpp>
+#include <mrbind14/gc.hpp>
+#include <mruby.h>
+#include <mruby/data.h>
+#include <mruby/compile.h>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+namespace mrbind14 {
+
+class function;
+class module;
+
+namespace detail {
+
+class enum_table;
+
+/// Per-interpreter data managed by mrbind14. An instance is attached
+/// to the ud field of the mrb_state the first time it is needed and
+/// is destroyed by close_state, after the mrb_state has been closed.
+struct state_data {
+
+  state_data() = default;
+
+  state_data(const state_data&) = delete;
+
+  state_data& operator=(const state_data&) = delete;
+
+  // defined in module.hpp, where function is a complete type
+  ~state_data();
+
+  /// Functions bound in this interpreter
+  std::vector<std::unique_ptr<function>> functions;
+
+  /// Ruby classes bound to C++ types with module::def_class
+  std::unordered_map<std::type_index, struct RClass*> classes;
+
+  /// Identity map from C++ objects to the Ruby objects wrapping them.
+  /// Entries are weak: they are removed when the Ruby object is freed.
+  std::unordered_map<const void*, struct RData*> instances;
+
+  /// Initializers of the modules registered with module::def_lazy_module
+  /// and not yet materialized, by parent module and name
+  std::map<std::pair<struct RClass*, mrb_sym>, std::function<void(module&)>> lazy_modules;
+
+  /// Whether Module#const_missing has been hooked to materialize them
+  bool lazy_hook_installed = false;
+
+  /// Class of the proxies created by module::def_shared_table
+  struct RClass* shared_table_class = nullptr;
+
+  /// Class of the objects wrapping the ranges returned to Ruby
+  struct RClass* range_class = nullptr;
+
+  /// Names of the C++ types in signatures and error messages
+  std::unordered_map<std::type_index, std::string> class_names;
+
+  /// Incremented whenever a name is registered, so that signatures
+  /// built from the previous names can be rebuilt
+  uint64_t class_names_version = 0;
+
+  /// Tables of the enums bound with module::def_enum, by enum_index
+  std::vector<std::unique_ptr<enum_table>> enums;
+
+  /// Compile context reused by interpreter::execute and execute_file
+  mrbc_context* compile_context = nullptr;
+
+  /// Sampling profiler for Ruby code
+  script_sampler sampler;
+
+  /// Number of collections completed through the interpreter's GC API
+  uint64_t gc_collections = 0;
+
+  /// Pause times of the collections run through the interpreter's GC API
+  gc_pause_histogram gc_pauses;
+};
+
+/// Retrieves the state_data attached to the mrb_state, creating it if needed
+inline state_data& get_state_data(mrb_state* mrb) {
+  if(!mrb->ud) mrb->ud = new state_data();
+  return *static_cast<state_data*>(mrb->ud);
+}
+
+/// Closes the mrb_state, then destroys its attached state_data
+MRBIND14_INLINE void close_state(mrb_state* mrb);
+
+#if MRBIND14_DEFINITIONS
+
+MRBIND14_INLINE void close_state(mrb_state* mrb) {
+  auto data = static_cast<state_data*>(mrb->ud);
+  if(data && data->compile_context)
+    mrbc_context_free(mrb, data->compile_context);
+  mrb_close(mrb);
+  delete data;
+}
+
+#ifdef MRB_ENABLE_DEBUG_HOOK
+MRBIND14_INLINE void script_sampler::hook(mrb_state* mrb, struct mrb_irep* irep, const mrb_code* pc, mrb_value* regs) {
+  auto& sampler = static_cast<state_data*>(mrb->ud)->sampler;
+  if(sampler.m_previous_hook) sampler.m_previous_hook(mrb, irep, pc, regs);
+  if(--sampler.m_countdown) return;
+  sampler.m_countdown = sampler.m_interval;
+  sampler.sample(mrb, irep, pc);
+}
+#endif
+
+#endif
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
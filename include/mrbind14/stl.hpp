@@ -0,0 +1,218 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_STL_H_
+#define MRBIND14_STL_H_
+
+#include <mrbind14/type_binder.hpp>
+#include <mruby.h>
+
+#if __cplusplus >= 201703L
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+
+namespace mrbind14 {
+
+namespace detail {
+
+constexpr uint64_t tag_bit(mrb_vtype tag) {
+  return uint64_t(1) << tag;
+}
+
+constexpr uint64_t all_tags = ~uint64_t(0);
+
+/// Describes which mrb_value tags a C++ type can be converted from:
+/// - exact: tags that naturally map to this type
+/// - accepted: tags that check_type may accept
+/// - definitive: whether a matching tag is enough for check_type to
+///   succeed, in which case no further check is needed
+template<typename T, typename Enable = void>
+struct value_tags {
+  static constexpr uint64_t exact      = 0;
+  static constexpr uint64_t accepted   = all_tags;
+  static constexpr bool     definitive = false;
+};
+
+template<typename Integer>
+struct value_tags<Integer, std::enable_if_t<is_integer_not_bool<Integer>::value>> {
+  static constexpr uint64_t exact      = tag_bit(MRB_TT_FIXNUM);
+  static constexpr uint64_t accepted   = tag_bit(MRB_TT_FIXNUM) | tag_bit(MRB_TT_FLOAT);
+  static constexpr bool     definitive = true;
+};
+
+template<typename Float>
+struct value_tags<Float, std::enable_if_t<is_floating_point<Float>::value>> {
+  static constexpr uint64_t exact      = tag_bit(MRB_TT_FLOAT);
+  static constexpr uint64_t accepted   = tag_bit(MRB_TT_FIXNUM) | tag_bit(MRB_TT_FLOAT);
+  static constexpr bool     definitive = true;
+};
+
+template<typename Bool>
+struct value_tags<Bool, std::enable_if_t<is_bool<Bool>::value>> {
+  static constexpr uint64_t exact      = tag_bit(MRB_TT_TRUE) | tag_bit(MRB_TT_FALSE);
+  static constexpr uint64_t accepted   = all_tags;
+  static constexpr bool     definitive = true;
+};
+
+template<typename String>
+struct value_tags<String, std::enable_if_t<
+  is_string<String>::value || is_c_style_string<String>::value
+  || std::is_same<std::decay_t<String>, std::string_view>::value>> {
+  static constexpr uint64_t exact      = tag_bit(MRB_TT_STRING) | tag_bit(MRB_TT_SYMBOL);
+  static constexpr uint64_t accepted   = exact;
+  static constexpr bool     definitive = true;
+};
+
+template<typename Value>
+struct value_tags<Value, std::enable_if_t<
+  std::is_same<std::decay_t<Value>, mrb_value>::value
+  || std::is_same<std::decay_t<Value>, object>::value>> {
+  static constexpr uint64_t exact      = 0;
+  static constexpr uint64_t accepted   = all_tags;
+  static constexpr bool     definitive = true;
+};
+
+template<typename T>
+struct value_tags<T, std::enable_if_t<is_bound_class<T>::value || is_bound_class_pointer<T>::value>> {
+  static constexpr uint64_t exact      = tag_bit(MRB_TT_DATA);
+  static constexpr uint64_t accepted   = tag_bit(MRB_TT_DATA) | tag_bit(MRB_TT_FALSE);
+  static constexpr bool     definitive = false;
+};
+
+template<>
+struct value_tags<std::monostate> {
+  static constexpr uint64_t exact      = tag_bit(MRB_TT_FALSE);
+  static constexpr uint64_t accepted   = exact;
+  static constexpr bool     definitive = false;
+};
+
+/// std::monostate maps to nil
+template<>
+struct type_binder<std::monostate> {
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, std::monostate) {
+    return mrb_nil_value();
+  }
+
+  static std::monostate mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    return std::monostate();
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return mrb_nil_p(val);
+  }
+
+};
+
+/// std::optional maps an empty optional to nil
+template<typename T>
+struct type_binder<std::optional<T>> {
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, const std::optional<T>& val) {
+    return val ? detail::cpp_to_mrb<T>(mrb, *val) : mrb_nil_value();
+  }
+
+  static std::optional<T> mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    if(mrb_nil_p(val)) return std::nullopt;
+    return detail::mrb_to_cpp<T>(mrb, val);
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return mrb_nil_p(val) || detail::check_type<T>(mrb, val);
+  }
+
+};
+
+/// Maps each mrb_value tag to the first alternative among A... that
+/// the tag maps to exactly, or else to the first one accepting it
+template<typename ... A>
+constexpr std::array<uint8_t, MRB_TT_MAXDEFINE> variant_tag_table() {
+  constexpr size_t   npos       = sizeof...(A);
+  constexpr uint64_t exact[]    = { value_tags<A>::exact... };
+  constexpr uint64_t accepted[] = { value_tags<A>::accepted... };
+  std::array<uint8_t, MRB_TT_MAXDEFINE> table{};
+  for(size_t tag = 0; tag < MRB_TT_MAXDEFINE; tag++) {
+    table[tag] = npos;
+    for(size_t i = npos; i-- > 0;)
+      if((accepted[i] >> tag) & 1) table[tag] = i;
+    for(size_t i = npos; i-- > 0;)
+      if((exact[i] >> tag) & 1) table[tag] = i;
+  }
+  return table;
+}
+
+/// std::variant converts from Ruby with a single switch on the value's
+/// tag: a table computed at compile time gives the alternative that
+/// the tag maps to, preferring exact matches (e.g. Float for double
+/// over int) and earlier alternatives. When check_type needs more than
+/// the tag (bound classes, enums, optionals), the alternative from the
+/// table is checked first, then all the alternatives in order.
+template<typename ... A>
+struct type_binder<std::variant<A...>> {
+
+  using variant_type = std::variant<A...>;
+
+  static constexpr size_t npos = sizeof...(A);
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, const variant_type& val) {
+    return std::visit([mrb](const auto& x) {
+      return detail::cpp_to_mrb<std::decay_t<decltype(x)>>(mrb, x);
+    }, val);
+  }
+
+  static variant_type mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    return convert(mrb, val, std::index_sequence_for<A...>());
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return select(mrb, val) != npos;
+  }
+
+  private:
+
+  static constexpr auto table = variant_tag_table<A...>();
+
+  static constexpr bool definitive[] = { value_tags<A>::definitive... };
+
+  static size_t select(mrb_state* mrb, mrb_value val) {
+    size_t tag = mrb_type(val);
+    size_t i = tag < MRB_TT_MAXDEFINE ? table[tag] : npos;
+    if(i != npos && definitive[i]) return i;
+    using checker = bool(*)(mrb_state*, mrb_value);
+    static constexpr checker checks[] = { &detail::check_type<A>... };
+    if(i != npos && checks[i](mrb, val)) return i;
+    for(size_t j = 0; j < npos; j++)
+      if(checks[j](mrb, val)) return j;
+    return npos;
+  }
+
+  template<size_t I>
+  static variant_type convert_alternative(mrb_state* mrb, mrb_value val) {
+    using alternative = std::variant_alternative_t<I, variant_type>;
+    return variant_type(std::in_place_index<I>, detail::mrb_to_cpp<alternative>(mrb, val));
+  }
+
+  template<size_t ... I>
+  static variant_type convert(mrb_state* mrb, mrb_value val, std::index_sequence<I...>) {
+    using converter = variant_type(*)(mrb_state*, mrb_value);
+    static constexpr converter converters[] = { &convert_alternative<I>... };
+    size_t i = select(mrb, val);
+    if(i == npos) throw std::runtime_error("No alternative of " + demangle<variant_type>() + " matches the value");
+    return converters[i](mrb, val);
+  }
+};
+
+} // namespace detail
+
+} // namespace mrbind14
+
+#endif
+
+#endif
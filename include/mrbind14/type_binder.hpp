@@ -4,8 +4,14 @@
 #include <mruby.h>
 #include <mruby/string.h>
 #include <mrbind14/mruby_util.hpp>
+#include <mrbind14/instance.hpp>
+#include <mrbind14/enum.hpp>
 #include <mrbind14/type_registry.hpp>
+#include <mrbind14/signature.hpp>
 #include <mrbind14/type_traits.hpp>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace mrbind14 {
 
@@ -15,9 +21,76 @@ namespace detail {
 /// - cpp_to_mrb converts a C++ value to an mrb_value
 /// - mrb_to_cpp converts an mrb_value to a C++ value
 /// - check_type checks if an mrb_value is convertible to the given C++ type
+///
+/// cpp_to_mrb does not manage the GC arena: objects it creates stay
+/// protected until the enclosing gc_arena_scope (e.g. the one opened
+/// around each bound function call) is closed.
 
+/// The primary template handles instances of classes bound with
+/// module::def_class: C++ values are copied into new Ruby objects.
 template<typename T, typename Enable = void>
-struct type_binder;
+struct type_binder {
+
+  using instance_type = std::decay_t<T>;
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, const instance_type& val) {
+    static_assert(std::is_class<instance_type>::value, "No type_binder for this type");
+    auto obj = std::make_shared<instance_type>(val);
+    return wrap_instance(mrb, obj.get(), obj);
+  }
+
+  static instance_type mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    static_assert(std::is_class<instance_type>::value, "No type_binder for this type");
+    auto ptr = get_instance_ptr<instance_type>(val);
+    if(!ptr) throw std::runtime_error("Ruby object does not wrap a " + demangle<instance_type>());
+    return *ptr;
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return get_instance_ptr<instance_type>(val) != nullptr;
+  }
+
+};
+
+/// Checks if a type is handled as an instance of a bound class
+template<typename T, typename Enable = void>
+struct is_bound_class : std::false_type {};
+
+template<typename T>
+struct is_bound_class<T,
+  decltype((void)sizeof(typename type_binder<std::decay_t<T>>::instance_type))>
+  : std::is_class<std::decay_t<T>> {};
+
+/// Checks if a type is a pointer to an instance of a bound class
+template<typename T, bool = std::is_pointer<std::decay_t<T>>::value>
+struct is_bound_class_pointer : std::false_type {};
+
+template<typename T>
+struct is_bound_class_pointer<T, true>
+  : is_bound_class<std::remove_pointer_t<std::decay_t<T>>> {};
+
+/// Pointers to instances of bound classes map to nil when null.
+/// Returned pointers are not owned by Ruby unless a return value
+/// policy says otherwise (see return_caster).
+template<typename Pointer>
+struct type_binder<Pointer, std::enable_if_t<is_bound_class_pointer<Pointer>::value>> {
+
+  using class_type = std::remove_cv_t<std::remove_pointer_t<std::decay_t<Pointer>>>;
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, Pointer ptr) {
+    if(!ptr) return mrb_nil_value();
+    return find_or_wrap_instance(mrb, const_cast<class_type*>(ptr), nullptr);
+  }
+
+  static std::decay_t<Pointer> mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    return mrb_nil_p(val) ? nullptr : get_instance_ptr<class_type>(val);
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return mrb_nil_p(val) || get_instance_ptr<class_type>(val) != nullptr;
+  }
+
+};
 
 template<typename Value>
 struct type_binder<Value,
@@ -88,14 +161,50 @@ struct type_binder<Bool, std::enable_if_t<is_bool<Bool>::value>> {
   }
 };
 
+/// Enums bound with module::def_enum convert from symbols (and
+/// integers) through the enum's table in the state. They convert to
+/// symbols, or to integers for bitflags, which combine with |.
+/// Other enums convert to and from their underlying integer.
+template<typename Enum>
+struct type_binder<Enum, std::enable_if_t<std::is_enum<std::decay_t<Enum>>::value>> {
+
+  using enum_type = std::decay_t<Enum>;
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, Enum e) {
+    auto value = static_cast<int64_t>(e);
+    auto table = find_enum_table<enum_type>(mrb);
+    if(table && !table->flags()) {
+      mrb_sym sym = table->find(value);
+      if(sym) return mrb_symbol_value(sym);
+    }
+    return mrb_fixnum_value(value);
+  }
+
+  static enum_type mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    auto table = find_enum_table<enum_type>(mrb);
+    int64_t value = 0;
+    if(table) {
+      if(!table->convert(mrb, val, value))
+        throw std::runtime_error("Invalid value for enum " + demangle<enum_type>());
+    } else {
+      value = mrb_fixnum(val);
+    }
+    return static_cast<enum_type>(value);
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    auto table = find_enum_table<enum_type>(mrb);
+    int64_t value;
+    return table ? table->convert(mrb, val, value) : mrb_fixnum_p(val);
+  }
+
+};
+
 template<typename CString>
 struct type_binder<CString, std::enable_if_t<is_c_style_string<CString>::value>> {
   
   static mrb_value cpp_to_mrb(mrb_state* mrb, CString str) {
-    int ai = mrb_gc_arena_save(mrb);
-    auto val = mrb_str_new_cstr(mrb, str);
-    mrb_gc_arena_restore(mrb, ai);
-    return val;
+    return mrb_str_new_cstr(mrb, str);
   }
 
   static auto mrb_to_cpp(mrb_state* mrb, mrb_value val) {
@@ -111,14 +220,68 @@ struct type_binder<CString, std::enable_if_t<is_c_style_string<CString>::value>>
 
 };
 
+/// Shared pointers to instances of bound classes share the ownership
+/// of the C++ object with the Ruby object, which releases its reference
+/// when it is garbage collected. Wrapping a pointer that is already
+/// wrapped returns the existing Ruby object.
+template<typename Holder>
+struct type_binder<Holder, std::enable_if_t<is_shared_ptr<std::decay_t<Holder>>::value>> {
+
+  using class_type = std::remove_cv_t<typename std::decay_t<Holder>::element_type>;
+  using holder_type = std::shared_ptr<class_type>;
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, const std::decay_t<Holder>& ptr) {
+    if(!ptr) return mrb_nil_value();
+    auto p = const_cast<class_type*>(ptr.get());
+    mrb_value obj = find_instance(mrb, p);
+    if(mrb_nil_p(obj))
+      return wrap_instance(mrb, p, std::const_pointer_cast<class_type>(ptr));
+    // a Ruby object referring to the C++ object now shares its ownership
+    auto inst = static_cast<instance*>(DATA_PTR(obj));
+    if(!inst->holder) inst->holder = std::const_pointer_cast<class_type>(ptr);
+    return obj;
+  }
+
+  /// The returned pointer shares the ownership of the Ruby object's
+  /// holder. Ruby objects referring to a C++ object without owning it
+  /// are rejected, since the callee could keep the pointer after the
+  /// C++ object is destroyed.
+  static std::decay_t<Holder> mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    if(mrb_nil_p(val)) return nullptr;
+    auto p = get_instance_ptr<class_type>(val);
+    if(!p) throw std::runtime_error("Ruby object does not wrap a " + demangle<class_type>());
+    auto& holder = static_cast<instance*>(DATA_PTR(val))->holder;
+    if(!holder)
+      throw std::runtime_error(std::string(mrb_obj_classname(mrb, val))
+                               + " does not own its C++ object and cannot be shared");
+    return holder_type(holder, p);
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    if(mrb_nil_p(val)) return true;
+    return get_instance_ptr<class_type>(val) != nullptr
+        && static_cast<instance*>(DATA_PTR(val))->holder != nullptr;
+  }
+
+};
+
+/// Unique pointers can only be returned to Ruby, which takes ownership
+/// of the C++ object (see return_caster); a Ruby object cannot give
+/// up its ownership, so they are not accepted as parameters.
+template<typename Holder>
+struct type_binder<Holder, std::enable_if_t<is_unique_ptr<std::decay_t<Holder>>::value>> {
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return false;
+  }
+
+};
+
 template<typename String>
 struct type_binder<String, std::enable_if_t<is_string<String>::value>> {
 
-  static mrb_value cpp_to_mrb(mrb_state* mrb, String str) {
-    int ai = mrb_gc_arena_save(mrb);
-    auto val = mrb_str_new(mrb, str.data(), str.size());
-    mrb_gc_arena_restore(mrb, ai);
-    return val;
+  static mrb_value cpp_to_mrb(mrb_state* mrb, const String& str) {
+    return mrb_str_new(mrb, str.data(), str.size());
   }
 
   static auto mrb_to_cpp(mrb_state* mrb, mrb_value val) {
@@ -134,12 +297,42 @@ struct type_binder<String, std::enable_if_t<is_string<String>::value>> {
 
 };
 
+#if __cplusplus >= 201703L
+/// String views refer to the bytes of the Ruby string, which stay
+/// valid for the duration of a bound function call
+template<>
+struct type_binder<std::string_view> {
+
+  static mrb_value cpp_to_mrb(mrb_state* mrb, std::string_view str) {
+    return mrb_str_new(mrb, str.data(), str.size());
+  }
+
+  static std::string_view mrb_to_cpp(mrb_state* mrb, mrb_value val) {
+    if(mrb_symbol_p(val)) {
+      mrb_int len;
+      const char* name = mrb_sym2name_len(mrb, mrb_symbol(val), &len);
+      return std::string_view(name, len);
+    }
+    return std::string_view(RSTRING_PTR(val), RSTRING_LEN(val));
+  }
+
+  static bool check_type(mrb_state* mrb, mrb_value val) {
+    return mrb_string_p(val) || mrb_symbol_p(val);
+  }
+
+};
+#endif
 
 template<typename T>
-mrb_value cpp_to_mrb(mrb_state* mrb, T val) {
+mrb_value cpp_to_mrb(mrb_state* mrb, const T& val) {
   return type_binder<T>::cpp_to_mrb(mrb, val);
 }
 
+template<typename T, size_t N>
+mrb_value cpp_to_mrb(mrb_state* mrb, const T (&val)[N]) {
+  return type_binder<const T*>::cpp_to_mrb(mrb, val);
+}
+
 template<typename T>
 T mrb_to_cpp(mrb_state* mrb, mrb_value val) {
   return type_binder<T>::mrb_to_cpp(mrb, val);
@@ -166,8 +359,7 @@ struct type_checker<P> {
   static bool check(mrb_state* mrb, int i, mrb_value* args, bool should_throw) {
     if(!type_binder<P>::check_type(mrb, args[i])) {
       if(should_throw) {
-        auto type_name = get_cpp_class_name<P>(mrb);
-        raise_invalid_type(mrb, i, type_name.c_str(), args[i]);
+        raise_invalid_type(mrb, i, type_name<P>(mrb), args[i]);
       }
       return false;
     }
@@ -180,8 +372,7 @@ struct type_checker<P1, P...> {
   static bool check(mrb_state* mrb, int i, mrb_value* args, bool should_throw) {
     if(!type_binder<P1>::check_type(mrb, args[i])) {
       if(should_throw) {
-        auto type_name = get_cpp_class_name<P1>(mrb);
-        raise_invalid_type(mrb, i, type_name.c_str(), args[i]);
+        raise_invalid_type(mrb, i, type_name<P1>(mrb), args[i]);
       }
       return false;
     } else {
@@ -196,14 +387,148 @@ bool check_arg_types(mrb_state* mrb, mrb_value* args, bool should_throw=true) {
   return type_checker<P...>::check(mrb, 0, args, should_throw);
 }
 
-/// Helper structure for parameter pack expension in function_binder.hpp
-template<typename T>
+/// Helper structure for parameter pack expension in function_binder.hpp.
+/// Parameters taken by const reference are converted into a temporary
+/// of the decayed type. In particular, a const std::string& parameter
+/// copies the bytes of the Ruby string into a new std::string on every
+/// call, since Ruby strings are not std::strings: functions called
+/// often should take const char* (or std::string_view) instead.
+template<typename T, typename Enable = void>
 struct type_converter {
   static std::decay_t<T> convert(mrb_state* mrb, mrb_value v) {
     return mrb_to_cpp<std::decay_t<T>>(mrb, v);
   }
 };
 
+/// References to instances of bound classes refer to the
+/// C++ object held by the Ruby object, without copy
+template<typename T>
+struct type_converter<T&, std::enable_if_t<is_bound_class<T>::value>> {
+  static T& convert(mrb_state* mrb, mrb_value v) {
+    return *get_instance_ptr<std::remove_cv_t<T>>(v);
+  }
+};
+
+/// C-style string parameters point to the bytes of the Ruby string
+/// instead of going through a temporary std::string
+template<typename CString>
+struct type_converter<CString, std::enable_if_t<
+  std::is_same<std::decay_t<CString>, const char*>::value>> {
+  static const char* convert(mrb_state* mrb, mrb_value v) {
+    if(mrb_symbol_p(v)) return mrb_sym2name(mrb, mrb_symbol(v));
+    return mrb_string_value_cstr(mrb, &v);
+  }
+};
+
+/// Pointers to instances of bound classes
+template<typename Pointer>
+struct type_converter<Pointer, std::enable_if_t<is_bound_class_pointer<Pointer>::value>> {
+  static std::decay_t<Pointer> convert(mrb_state* mrb, mrb_value v) {
+    return type_binder<std::decay_t<Pointer>>::mrb_to_cpp(mrb, v);
+  }
+};
+
+/// Converts the value returned by a bound function of return type R.
+/// For instances of bound classes, the return value policy decides
+/// whether the Ruby object owns a copy, a moved-from object or the
+/// returned pointer, or merely refers to the C++ object; other values
+/// are converted with their type_binder.
+template<typename R, typename Enable = void>
+struct return_caster {
+  template<typename V>
+  static mrb_value cast(mrb_state* mrb, V&& val, return_value_policy, mrb_value) {
+    return type_binder<std::decay_t<R>>::cpp_to_mrb(mrb, val);
+  }
+};
+
+template<typename R>
+struct return_caster<R, std::enable_if_t<is_bound_class<R>::value>> {
+
+  using class_type = std::decay_t<R>;
+
+  template<typename V>
+  static mrb_value cast(mrb_state* mrb, V&& val, return_value_policy policy, mrb_value parent) {
+    switch(resolve(policy)) {
+    case return_value_policy::reference:
+    case return_value_policy::reference_internal:
+      return wrap_reference(mrb, const_cast<class_type*>(&val), policy, parent);
+    case return_value_policy::copy:
+      return wrap(mrb, std::make_shared<class_type>(static_cast<const class_type&>(val)));
+    default:
+      return wrap(mrb, std::make_shared<class_type>(std::move(val)));
+    }
+  }
+
+  private:
+
+  /// Values are moved and references copied, unless specified otherwise.
+  /// Only references can be wrapped without ownership.
+  static return_value_policy resolve(return_value_policy policy) {
+    constexpr bool by_value = !std::is_reference<R>::value;
+    switch(policy) {
+    case return_value_policy::reference:
+    case return_value_policy::reference_internal:
+      return by_value ? return_value_policy::move : policy;
+    case return_value_policy::copy:
+      return policy;
+    case return_value_policy::move:
+      return std::is_const<std::remove_reference_t<R>>::value
+        ? return_value_policy::copy : policy;
+    default:
+      return by_value ? return_value_policy::move : return_value_policy::copy;
+    }
+  }
+
+  static mrb_value wrap(mrb_state* mrb, std::shared_ptr<class_type> obj) {
+    auto ptr = obj.get();
+    return wrap_instance(mrb, ptr, std::move(obj));
+  }
+};
+
+template<typename R>
+struct return_caster<R, std::enable_if_t<is_bound_class_pointer<R>::value>> {
+
+  using class_type = std::remove_cv_t<std::remove_pointer_t<R>>;
+
+  static mrb_value cast(mrb_state* mrb, R ptr, return_value_policy policy, mrb_value parent) {
+    if(!ptr) return mrb_nil_value();
+    auto p = const_cast<class_type*>(ptr);
+    switch(policy) {
+    case return_value_policy::copy:
+      return return_caster<const class_type&>::cast(mrb, *p, policy, parent);
+    case return_value_policy::move:
+      return return_caster<class_type&>::cast(mrb, *p, policy, parent);
+    case return_value_policy::take_ownership: {
+      mrb_value obj = find_instance(mrb, p);
+      if(mrb_nil_p(obj)) return wrap_instance(mrb, p, std::shared_ptr<class_type>(p));
+      // a Ruby object referring to the C++ object now owns it
+      auto inst = static_cast<instance*>(DATA_PTR(obj));
+      if(!inst->holder) inst->holder = std::shared_ptr<class_type>(p);
+      return obj;
+    }
+    default:
+      return wrap_reference(mrb, p, policy, parent);
+    }
+  }
+};
+
+template<typename R>
+struct return_caster<R, std::enable_if_t<is_unique_ptr<std::decay_t<R>>::value>> {
+
+  using holder_type = std::shared_ptr<typename std::decay_t<R>::element_type>;
+
+  template<typename V>
+  static mrb_value cast(mrb_state* mrb, V&& val, return_value_policy, mrb_value) {
+    static_assert(!std::is_lvalue_reference<V>::value,
+        "Unique pointers can only be returned by value");
+    return type_binder<holder_type>::cpp_to_mrb(mrb, holder_type(std::move(val)));
+  }
+};
+
+/// Type produced by type_converter<T>::convert
+template<typename T>
+using converted_t = decltype(type_converter<T>::convert(nullptr, mrb_value()));
+
 } // namespace detail
 
 } // namespace mrbind14
@@ -218,7 +543,7 @@ template<typename Object>
 struct type_binder<Object, std::enable_if_t<std::is_same<std::decay_t<Object>,object>::value>> {
 
   static mrb_value cpp_to_mrb(mrb_state* mrb, Object val) {
-    return val.native();
+    return val.value();
   }
 
   static auto mrb_to_cpp(mrb_state* mrb, mrb_value val) {
@@ -235,4 +560,27 @@ struct type_binder<Object, std::enable_if_t<std::is_same<std::decay_t<Object>,ob
 
 } // namespace mrbind14
 
+#include <mrbind14/stl.hpp>
+#include <mrbind14/range.hpp>
+#include <mrbind14/block.hpp>
+
+/// Types whose type_binder is explicitly instantiated by the compiled
+/// library (see config.hpp)
+#define MRBIND14_FOR_EACH_COMMON_TYPE(X) \
+  X(bool) X(char) X(short) X(int) X(long) X(long long) \
+  X(unsigned char) X(unsigned short) X(unsigned int) \
+  X(unsigned long) X(unsigned long long) \
+  X(float) X(double) X(std::string) X(const char*) \
+  X(mrb_value) X(mrbind14::object)
+
+#if defined(MRBIND14_COMPILED_LIBRARY) && !defined(MRBIND14_IMPLEMENTATION)
+namespace mrbind14 {
+namespace detail {
+#define MRBIND14_EXTERN_TYPE_BINDER(T) extern template struct type_binder<T>;
+MRBIND14_FOR_EACH_COMMON_TYPE(MRBIND14_EXTERN_TYPE_BINDER)
+#undef MRBIND14_EXTERN_TYPE_BINDER
+} // namespace detail
+} // namespace mrbind14
+#endif
+
 #endif
@@ -1,10 +1,9 @@
 #ifndef MRBIND14_TYPE_REGISTRY_H_
 #define MRBIND14_TYPE_REGISTRY_H_
 
+#include <mrbind14/config.hpp>
+#include <mrbind14/state.hpp>
 #include <mruby.h>
-#include <mruby/hash.h>
-#include <mruby/variable.h>
-#include <mruby/string.h>
 #include <string>
 #include <typeindex>
 #include <typeinfo>
@@ -20,10 +19,49 @@ namespace mrbind14 {
 namespace detail {
 
 /// By default mrbind14 will use the C++ demangled name for a type
-#ifdef __GNUG__
+MRBIND14_INLINE std::string demangle(const std::type_info& type);
+
 template<typename T>
 std::string demangle() {
-    auto name = typeid(T).name();
+    return demangle(typeid(T));
+}
+
+/// This function registers the names of the built-in types in the
+/// registry of the mrb_state (see state_data::class_names)
+MRBIND14_INLINE void init_cpp_class_names(mrb_state* mrb);
+
+/// This function adds the name of a type into the registry
+MRBIND14_INLINE void register_cpp_class_name(mrb_state* mrb, const std::type_info& type, const char* name);
+
+/// This function retrieves the name of a type from the mrb_state.
+/// Types not registered get their demangled name, which is then
+/// stored so that the returned pointer (owned by the registry)
+/// remains valid until the name of the type is registered again.
+MRBIND14_INLINE const char* find_cpp_class_name(mrb_state* mrb, const std::type_info& type);
+
+/// The registry is keyed on std::type_info, so that the templates below
+/// only forward to the functions above and cost almost nothing to
+/// instantiate for each type.
+template<typename T>
+void register_cpp_class_name(mrb_state* mrb, const char* name) {
+  register_cpp_class_name(mrb, typeid(typename std::decay<T>::type), name);
+}
+
+template<typename T>
+const char* find_cpp_class_name(mrb_state* mrb) {
+  return find_cpp_class_name(mrb, typeid(typename std::decay<T>::type));
+}
+
+template<typename T>
+std::string get_cpp_class_name(mrb_state* mrb) {
+  return find_cpp_class_name<T>(mrb);
+}
+
+#if MRBIND14_DEFINITIONS
+
+#ifdef __GNUG__
+MRBIND14_INLINE std::string demangle(const std::type_info& type) {
+    auto name = type.name();
     int status = -4; 
     std::unique_ptr<char, void(*)(void*)> res {
         abi::__cxa_demangle(name, NULL, NULL, &status),
@@ -32,67 +70,54 @@ std::string demangle() {
     return (status == 0) ? res.get() : name;
 }
 #else
-template<typename T>
-inline std::string demangle(const char* name) {
-    return typeid(T).name();
+MRBIND14_INLINE std::string demangle(const std::type_info& type) {
+    return type.name();
 }
 #endif
 
-template<typename T>
-void register_cpp_class_name(mrb_state* mrb, const char* name);
-
-/// This function sets up the $__cpp_class_names__ global variable in the mrb_state
-inline void init_cpp_class_names(mrb_state* mrb) {
-  mrb_sym sym = mrb_intern_lit(mrb, "$__cpp_class_names__");
-  mrb_value hash = mrb_gv_get(mrb, sym);
-  if(!mrb_nil_p(hash)) return;
-  hash = mrb_hash_new(mrb);
-  mrb_gv_set(mrb, sym, hash);
-  register_cpp_class_name<void>(              mrb, "void");
-  register_cpp_class_name<bool>(              mrb, "bool");
-  register_cpp_class_name<int>(               mrb, "int");
-  register_cpp_class_name<char>(              mrb, "char");
-  register_cpp_class_name<wchar_t>(           mrb, "wchar");
-  register_cpp_class_name<short>(             mrb, "short");
-  register_cpp_class_name<long>(              mrb, "long");
-  register_cpp_class_name<long long>(         mrb, "long long");
-  register_cpp_class_name<unsigned>(          mrb, "unsigned");
-  register_cpp_class_name<unsigned char>(     mrb, "char");
-  register_cpp_class_name<unsigned short>(    mrb, "unsigned");
-  register_cpp_class_name<unsigned long>(     mrb, "unsigned");
-  register_cpp_class_name<unsigned long long>(mrb, "unsigned long long");
-  register_cpp_class_name<float>(             mrb, "float");
-  register_cpp_class_name<double>(            mrb, "double");
-  register_cpp_class_name<long double>(       mrb, "long double");
+/// Returns the registry of the mrb_state, filled with the names of the
+/// built-in types on first use
+MRBIND14_INLINE std::unordered_map<std::type_index, std::string>& cpp_class_names(mrb_state* mrb) {
+  auto& names = get_state_data(mrb).class_names;
+  if(names.empty()) init_cpp_class_names(mrb);
+  return names;
 }
 
-/// This function adds the name of type T into the $__cpp_class_name__ array
-template<typename T>
-void register_cpp_class_name(mrb_state* mrb, const char* name) {
-  mrb_sym sym    = mrb_intern_lit(mrb, "$__cpp_class_names__");
-  mrb_value hash = mrb_gv_get(mrb, sym);
-  if(mrb_nil_p(hash))
-      init_cpp_class_names(mrb);
-  size_t id      = typeid(typename std::decay<T>::type).hash_code();
-  mrb_value key  = mrb_fixnum_value(id);
-  mrb_value val  = mrb_str_new_cstr(mrb, name);
-  mrb_hash_set(mrb, hash, key, val);
+MRBIND14_INLINE void init_cpp_class_names(mrb_state* mrb) {
+  auto& names = get_state_data(mrb).class_names;
+  names[typeid(void)]               = "void";
+  names[typeid(bool)]               = "bool";
+  names[typeid(int)]                = "int";
+  names[typeid(char)]               = "char";
+  names[typeid(wchar_t)]            = "wchar";
+  names[typeid(short)]              = "short";
+  names[typeid(long)]               = "long";
+  names[typeid(long long)]          = "long long";
+  names[typeid(unsigned)]           = "unsigned";
+  names[typeid(unsigned char)]      = "unsigned char";
+  names[typeid(unsigned short)]     = "unsigned short";
+  names[typeid(unsigned long)]      = "unsigned long";
+  names[typeid(unsigned long long)] = "unsigned long long";
+  names[typeid(float)]              = "float";
+  names[typeid(double)]             = "double";
+  names[typeid(long double)]        = "long double";
 }
 
-/// This function retrieves the name of the type T from the mrb_state
-template<typename T>
-std::string get_cpp_class_name(mrb_state* mrb) {
-  mrb_sym sym    = mrb_intern_lit(mrb, "$__cpp_class_names__");
-  mrb_value hash = mrb_gv_get(mrb, sym);
-  if(mrb_nil_p(hash))
-      init_cpp_class_names(mrb);
-  auto id        = typeid(typename std::decay<T>::type).hash_code();
-  mrb_value key  = mrb_fixnum_value(id);
-  mrb_value def  = mrb_str_new_cstr(mrb, demangle<T>().c_str());
-  mrb_value val  = mrb_hash_fetch(mrb, hash, key, def);
-  return std::string(RSTRING_PTR(val), RSTRING_LEN(val));
+MRBIND14_INLINE void register_cpp_class_name(mrb_state* mrb, const std::type_info& type, const char* name) {
+  cpp_class_names(mrb)[std::type_index(type)] = name;
+  get_state_data(mrb).class_names_version += 1;
 }
 
+MRBIND14_INLINE const char* find_cpp_class_name(mrb_state* mrb, const std::type_info& type) {
+  auto& names = cpp_class_names(mrb);
+  auto it     = names.find(std::type_index(type));
+  if(it == names.end())
+      it = names.emplace(std::type_index(type), demangle(type)).first;
+  return it->second.c_str();
+}
+
+#endif
+
 } // namespace detail
 
 } // namespace mrbind14
@@ -3,6 +3,8 @@
 
 #include <type_traits>
 #include <string>
+#include <functional>
+#include <memory>
 
 namespace mrbind14 {
 
@@ -43,6 +45,20 @@ struct is_string {
     std::is_same<std::string, std::decay_t<T>>::value;
 };
 
+/// Checks if a type is an std::shared_ptr
+template<typename T>
+struct is_shared_ptr : std::false_type {};
+
+template<typename T>
+struct is_shared_ptr<std::shared_ptr<T>> : std::true_type {};
+
+/// Checks if a type is an std::unique_ptr with the default deleter
+template<typename T>
+struct is_unique_ptr : std::false_type {};
+
+template<typename T>
+struct is_unique_ptr<std::unique_ptr<T>> : std::true_type {};
+
 /// Removes the class component in member function types,
 /// e.g. remove_class<R (C::*)(A...)>::type = R(A...)
 template<typename T>
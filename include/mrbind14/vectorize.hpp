@@ -0,0 +1,232 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+#ifndef MRBIND14_VECTORIZE_H_
+#define MRBIND14_VECTORIZE_H_
+
+#include <mrbind14/module.hpp>
+#include <mrbind14/cpp_function.hpp>
+#include <mrbind14/state.hpp>
+#include <mrbind14/gc.hpp>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mrbind14 {
+
+namespace detail {
+
+/// Type in which the elements of a vectorized call are staged.
+/// Booleans are staged as chars to avoid the std::vector<bool> proxy.
+template<typename T>
+using staged_t = std::conditional_t<std::is_same<std::decay_t<T>, bool>::value, char, std::decay_t<T>>;
+
+/// Checks if values of all the types can be staged for a vectorized call
+template<typename ... T>
+struct are_vectorizable;
+
+template<>
+struct are_vectorizable<> : std::true_type {};
+
+template<typename T1, typename ... T>
+struct are_vectorizable<T1, T...>
+  : std::integral_constant<bool, (std::is_arithmetic<std::decay_t<T1>>::value || is_string<T1>::value)
+                              && are_vectorizable<T...>::value> {};
+
+/// A scalar function bound with module::def_vectorized. Calls in which
+/// no argument is an Array go to the scalar function. Otherwise each
+/// argument is converted once into a contiguous buffer (scalars being
+/// repeated), the callable runs over the buffers in a plain loop, which
+/// the compiler can inline and vectorize, and the results are returned
+/// as an Array. With MRBIND14_ENABLE_PROFILING, a vectorized call counts
+/// as one call, whose conversion time includes the staging of the
+/// arguments, and the profile includes the scalar calls.
+template<typename F, typename Signature>
+class vectorized_function_impl;
+
+template<typename F, typename R, typename ... P>
+class vectorized_function_impl<F, R(P...)> : public abstract_function {
+
+  static_assert(are_vectorizable<R>::value,
+      "A vectorized function must return a number, a boolean or a string");
+  static_assert(are_vectorizable<P...>::value,
+      "The parameters of a vectorized function must be numbers, booleans or strings");
+
+  using scalar_type  = function_impl<R(P...)>;
+  using staging_type = std::tuple<std::vector<staged_t<P>>...>;
+
+  public:
+
+  template<typename ... Extra>
+  vectorized_function_impl(F fun, const Extra&... extra)
+  : m_scalar(std::function<R(P...)>(fun), extra...)
+  , m_function(std::move(fun)) {}
+
+  void initialize(mrb_state* mrb) override {
+    m_scalar.initialize(mrb);
+  }
+
+  mrb_value call(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args, mrb_value blk) const override {
+    if(!is_vector_call(mrb, nargs, args)) return m_scalar.call(mrb, self, nargs, args, blk);
+    gc_arena_scope arena(mrb);
+    return arena.escape(call_vectorized(mrb, args, std::index_sequence_for<P...>()));
+  }
+
+  bool check_args(mrb_state* mrb, mrb_value self, unsigned nargs, mrb_value* args, mrb_value blk) const override {
+    if(!is_vector_call(mrb, nargs, args)) return m_scalar.check_args(mrb, self, nargs, args, blk);
+    return true;
+  }
+
+  const char* signature(mrb_state* mrb) const override {
+    return m_scalar.signature(mrb);
+  }
+
+  memo_cache* cache() const override {
+    return m_scalar.cache();
+  }
+
+#if MRBIND14_ENABLE_PROFILING
+  call_stats stats() const override {
+    call_stats s = m_stats;
+    s.add(m_scalar.stats());
+    return s;
+  }
+
+  void reset_stats() override {
+    abstract_function::reset_stats();
+    m_scalar.reset_stats();
+  }
+#endif
+
+  private:
+
+  /// A vector call passes all the parameters positionally, at least one
+  /// of them being an Array and the others valid scalars
+  bool is_vector_call(mrb_state* mrb, unsigned nargs, mrb_value* args) const {
+    using checker = bool(*)(mrb_state*, mrb_value);
+    static const checker checks[] = { &check_type<std::decay_t<P>>..., nullptr };
+    if(nargs != sizeof...(P)) return false;
+    bool has_array = false;
+    for(unsigned i = 0; i < nargs; i++) {
+      if(mrb_array_p(args[i])) has_array = true;
+      else if(!checks[i](mrb, args[i])) return false;
+    }
+    return has_array;
+  }
+
+  template<size_t ... I>
+  mrb_value call_vectorized(mrb_state* mrb, mrb_value* args, std::index_sequence<I...>) const {
+    call_timer<profiling_enabled::value> timer;
+    mrb_int n = check_elements(mrb, args);
+    staging_type staged;
+    int dummy[] = { 0, (stage<P>(mrb, args[I], n, std::get<I>(staged)), 0)... };
+    (void)dummy;
+    timer.converted();
+    std::vector<staged_t<R>> results(n);
+    run(results.data(), n, std::get<I>(staged).data()...);
+    mrb_value ary = mrb_ary_new_capa(mrb, n);
+    int ai = mrb_gc_arena_save(mrb);
+    for(mrb_int k = 0; k < n; k++) {
+      mrb_ary_push(mrb, ary, cpp_to_mrb<std::decay_t<R>>(mrb, static_cast<std::decay_t<R>>(results[k])));
+      mrb_gc_arena_restore(mrb, ai);
+    }
+#if MRBIND14_ENABLE_PROFILING
+    timer.finish(m_stats);
+#endif
+    return ary;
+  }
+
+  /// Checks the lengths of the Arrays and the types of their elements
+  /// before any buffer is allocated, and returns the common length
+  static mrb_int check_elements(mrb_state* mrb, mrb_value* args) {
+    using checker = bool(*)(mrb_state*, mrb_value);
+    static const checker checks[] = { &check_type<std::decay_t<P>>..., nullptr };
+    mrb_int n = -1;
+    for(size_t i = 0; i < sizeof...(P); i++) {
+      if(!mrb_array_p(args[i])) continue;
+      mrb_int len = RARRAY_LEN(args[i]);
+      if(n >= 0 && len != n)
+        throw std::runtime_error("Arrays of different lengths (" + std::to_string(n)
+                                 + " and " + std::to_string(len) + ")");
+      n = len;
+    }
+    for(size_t i = 0; i < sizeof...(P); i++) {
+      if(!mrb_array_p(args[i])) continue;
+      const mrb_value* elements = RARRAY_PTR(args[i]);
+      for(mrb_int k = 0; k < n; k++) {
+        if(checks[i](mrb, elements[k])) continue;
+        const std::string names[] = { static_type_name<std::decay_t<P>>::name().c_str()... };
+        throw std::runtime_error(std::string("Cannot convert ") + mrb_obj_classname(mrb, elements[k])
+                                 + " into " + names[i] + " (element " + std::to_string(k)
+                                 + " of argument " + std::to_string(i + 1) + ")");
+      }
+    }
+    return n;
+  }
+
+  /// Conversion pass of one argument into its buffer, once checked
+  template<typename T>
+  static void stage(mrb_state* mrb, mrb_value arg, mrb_int n, std::vector<staged_t<T>>& buffer) {
+    using value_type = std::decay_t<T>;
+    if(!mrb_array_p(arg)) {
+      buffer.assign(n, mrb_to_cpp<value_type>(mrb, arg));
+      return;
+    }
+    buffer.reserve(n);
+    const mrb_value* elements = RARRAY_PTR(arg);
+    for(mrb_int k = 0; k < n; k++)
+      buffer.push_back(mrb_to_cpp<value_type>(mrb, elements[k]));
+  }
+
+  template<typename ... S>
+  void run(staged_t<R>* results, mrb_int n, const S*... inputs) const {
+    for(mrb_int k = 0; k < n; k++)
+      results[k] = m_function(inputs[k]...);
+  }
+
+  scalar_type m_scalar;
+  F           m_function;
+};
+
+/// Signature of a function pointer or function object
+template<typename F>
+struct callable_signature {
+  using type = function_signature_t<F>;
+};
+
+template<typename R, typename ... P>
+struct callable_signature<R(*)(P...)> {
+  using type = R(P...);
+};
+
+template<typename Function, typename ... Extra>
+std::unique_ptr<abstract_function> make_vectorized(Function&& f, const Extra&... extra) {
+  using callable_type = std::decay_t<Function>;
+  using signature     = typename callable_signature<callable_type>::type;
+  using function_type = vectorized_function_impl<callable_type, signature>;
+  return std::make_unique<function_type>(callable_type(std::forward<Function>(f)), extra...);
+}
+
+} // namespace detail
+
+template<typename Function, typename ... Extra>
+module& module::def_vectorized(const char* name, Function&& f, const Extra&... extra) {
+  auto& functions = detail::get_state_data(m_mrb).functions;
+  functions.push_back(std::make_unique<function>(name, detail::make_vectorized(std::forward<Function>(f), extra...)));
+  auto fptr = functions.back().get();
+  fptr->initialize(m_mrb);
+  detail::define_module_function(m_mrb, m_module, name, fptr);
+  return *this;
+}
+
+}
+
+#endif
@@ -0,0 +1,22 @@
+/*
+   Copyright (c) 2020 Matthieu Dorier <matthieu.dorier@gmail.com>
+   All rights reserved. Use of this source code is governed by a
+   BSD-style license that can be found in the LICENSE file.
+ */
+
+// Compiled part of mrbind14, built by the mrbind14_compiled target
+// (see config.hpp). It provides the definitions of the functions marked
+// MRBIND14_INLINE in the headers and the common type_binder instantiations.
+#define MRBIND14_IMPLEMENTATION
+#include <mrbind14/mrbind14.hpp>
+#include <mrbind14/json.hpp>
+
+namespace mrbind14 {
+namespace detail {
+
+#define MRBIND14_INSTANTIATE_TYPE_BINDER(T) template struct type_binder<T>;
+MRBIND14_FOR_EACH_COMMON_TYPE(MRBIND14_INSTANTIATE_TYPE_BINDER)
+#undef MRBIND14_INSTANTIATE_TYPE_BINDER
+
+} // namespace detail
+} // namespace mrbind14
@@ -0,0 +1,276 @@
+#include <mrbind14/mrbind14.hpp>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <cstring>
+#include <memory>
+#include <iostream>
+
+using namespace std::string_literals;
+
+class Counter {
+
+    public:
+
+    Counter(int start = 0)
+    : m_value(start) {}
+
+    void increment(int n) {
+        m_value += n;
+    }
+
+    int value() const {
+        return m_value;
+    }
+
+    private:
+
+    int m_value;
+};
+
+class Other {};
+
+class Registry {
+
+    public:
+
+    Counter& counter() {
+        return m_counter;
+    }
+
+    Counter* find(int i) {
+        return i == 0 ? &m_counter : nullptr;
+    }
+
+    private:
+
+    Counter m_counter;
+};
+
+class class_test : public CppUnit::TestFixture {
+
+    CPPUNIT_TEST_SUITE( class_test );
+    CPPUNIT_TEST( test_def_class );
+    CPPUNIT_TEST( test_def_init );
+    CPPUNIT_TEST( test_def_method );
+    CPPUNIT_TEST( test_def_lambda_method );
+    CPPUNIT_TEST( test_return_instance );
+    CPPUNIT_TEST( test_wrong_self );
+    CPPUNIT_TEST( test_return_reference );
+    CPPUNIT_TEST( test_return_copy );
+    CPPUNIT_TEST( test_return_pointer );
+    CPPUNIT_TEST( test_pointer_argument );
+    CPPUNIT_TEST( test_shared_ptr_holder );
+    CPPUNIT_TEST( test_unique_ptr_holder );
+    CPPUNIT_TEST( test_identity );
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+
+    void setUp() {}
+    void tearDown() {}
+
+    void test_def_class() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter");
+
+        CPPUNIT_ASSERT_NO_THROW(mruby.execute("Counter"));
+        CPPUNIT_ASSERT_THROW(mruby.execute("Undefined"), std::runtime_error);
+    }
+
+    void test_def_init() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter")
+             .def_init<int>()
+             .def_method("value", &Counter::value);
+
+        CPPUNIT_ASSERT_EQUAL(42, mruby.execute("Counter.new(42).value").as<int>());
+        CPPUNIT_ASSERT_THROW(mruby.execute("Counter.new('a')"), std::bad_function_call);
+    }
+
+    void test_def_method() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter")
+             .def_init<int>()
+             .def_method("increment", &Counter::increment)
+             .def_method("value", &Counter::value);
+
+        std::string code = R"ruby(
+            c = Counter.new(1)
+            c.increment(2)
+            c.increment(3)
+            c.value
+        )ruby";
+
+        CPPUNIT_ASSERT_EQUAL(6, mruby.execute(code.c_str()).as<int>());
+    }
+
+    void test_def_lambda_method() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter")
+             .def_init<int>()
+             .def_method("double", [](const Counter& c) { return 2*c.value(); })
+             .def_method("reset",  [](Counter& c, int v) { c = Counter(v); });
+
+        CPPUNIT_ASSERT_EQUAL(8, mruby.execute("Counter.new(4).double").as<int>());
+        CPPUNIT_ASSERT_EQUAL(6, mruby.execute("c = Counter.new(4); c.reset(3); c.double").as<int>());
+    }
+
+    void test_return_instance() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter")
+             .def_method("value", &Counter::value);
+        mruby.def_function("make_counter", [](int v) { return Counter(v); });
+        mruby.def_function("value_of", [](const Counter& c) { return c.value(); });
+
+        CPPUNIT_ASSERT_EQUAL(5, mruby.execute("make_counter(5).value").as<int>());
+        CPPUNIT_ASSERT_EQUAL(7, mruby.execute("value_of(make_counter(7))").as<int>());
+        CPPUNIT_ASSERT_EQUAL(3, mruby.execute("make_counter(3)").as<Counter>().value());
+    }
+
+    void test_wrong_self() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter")
+             .def_init<int>()
+             .def_method("value", &Counter::value);
+        mruby.def_class<Other>("Other")
+             .def_init<>();
+        mruby.def_function("value_of", [](const Counter& c) { return c.value(); });
+
+        CPPUNIT_ASSERT_THROW(mruby.execute("value_of(Other.new)"), std::bad_function_call);
+        CPPUNIT_ASSERT_THROW(mruby.execute("value_of(1)"), std::bad_function_call);
+        CPPUNIT_ASSERT_THROW(mruby.execute("Counter.allocate.value"), std::bad_function_call);
+    }
+
+    void test_return_reference() {
+        using mrbind14::return_value_policy;
+        mrbind14::interpreter mruby;
+
+        Registry registry;
+        mruby.def_class<Counter>("Counter")
+             .def_method("increment", &Counter::increment)
+             .def_method("value", &Counter::value);
+        mruby.def_class<Registry>("Registry")
+             .def_init<>()
+             .def_method("counter", &Registry::counter, return_value_policy::reference_internal);
+        mruby.def_function("global_counter", [&registry]() -> Counter& { return registry.counter(); },
+                           return_value_policy::reference);
+
+        mruby.execute("global_counter.increment(3)");
+        mruby.execute("global_counter.increment(4)");
+        CPPUNIT_ASSERT_EQUAL(7, registry.counter().value());
+        // references do not own their object, so they cannot be shared
+        mruby.def_function("keep", [](std::shared_ptr<Counter> c) { return c != nullptr; });
+        CPPUNIT_ASSERT_THROW(mruby.execute("keep(global_counter)"), std::bad_function_call);
+
+        std::string code = R"ruby(
+            c = Registry.new.counter
+            GC.start
+            c.increment(2)
+            c.value
+        )ruby";
+        CPPUNIT_ASSERT_EQUAL(2, mruby.execute(code.c_str()).as<int>());
+    }
+
+    void test_return_copy() {
+        mrbind14::interpreter mruby;
+
+        Registry registry;
+        mruby.def_class<Counter>("Counter")
+             .def_method("increment", &Counter::increment);
+        mruby.def_function("global_counter", [&registry]() -> Counter& { return registry.counter(); });
+
+        mruby.execute("global_counter.increment(3)");
+        CPPUNIT_ASSERT_EQUAL(0, registry.counter().value());
+    }
+
+    void test_return_pointer() {
+        using mrbind14::return_value_policy;
+        mrbind14::interpreter mruby;
+
+        Registry registry;
+        mruby.def_class<Counter>("Counter")
+             .def_method("increment", &Counter::increment)
+             .def_method("value", &Counter::value);
+        mruby.def_function("find", [&registry](int i) { return registry.find(i); },
+                           return_value_policy::reference);
+
+        CPPUNIT_ASSERT_NO_THROW(mruby.execute("find(0).increment(5)"));
+        CPPUNIT_ASSERT_EQUAL(5, registry.counter().value());
+        CPPUNIT_ASSERT(mruby.execute("find(1).nil?").as<bool>());
+
+        // pointers are not owned by default: collecting the Ruby object
+        // leaves the registry's counter alone
+        mruby.def_function("find_default", [&registry](int i) { return registry.find(i); });
+        mruby.execute("find_default(0).increment(1); GC.start");
+        CPPUNIT_ASSERT_EQUAL(6, registry.counter().value());
+
+        mruby.def_function("make_counter", [](int v) { return new Counter(v); },
+                           return_value_policy::take_ownership);
+        CPPUNIT_ASSERT_EQUAL(7, mruby.execute("make_counter(7).value").as<int>());
+    }
+
+    void test_pointer_argument() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter")
+             .def_init<int>();
+        mruby.def_function("value_or", [](const Counter* c, int v) { return c ? c->value() : v; });
+        mruby.def_function("length", [](const char* str) { return (int)std::strlen(str); });
+
+        CPPUNIT_ASSERT_EQUAL(3, mruby.execute("value_or(Counter.new(3), 1)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(1, mruby.execute("value_or(nil, 1)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(5, mruby.execute("length('hello')").as<int>());
+    }
+
+    void test_shared_ptr_holder() {
+        auto counter = std::make_shared<Counter>(1);
+        {
+            mrbind14::interpreter mruby;
+
+            mruby.def_class<Counter>("Counter")
+                 .def_method("increment", &Counter::increment);
+            mruby.def_function("shared_counter", [counter]() { return counter; });
+            mruby.def_function("use_count", [](std::shared_ptr<Counter> c) { return (int)c.use_count(); });
+
+            CPPUNIT_ASSERT(mruby.execute("shared_counter.equal?(shared_counter)").as<bool>());
+            mruby.execute("$c = shared_counter; $c.increment(2)");
+            CPPUNIT_ASSERT_EQUAL(3, counter->value());
+            // held by the test, the lambda, the Ruby object and the parameter
+            CPPUNIT_ASSERT_EQUAL(4, mruby.execute("use_count($c)").as<int>());
+        }
+        CPPUNIT_ASSERT_EQUAL(1L, counter.use_count());
+    }
+
+    void test_unique_ptr_holder() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_class<Counter>("Counter")
+             .def_method("value", &Counter::value);
+        mruby.def_function("make_counter", [](int v) { return std::make_unique<Counter>(v); });
+
+        CPPUNIT_ASSERT_EQUAL(4, mruby.execute("make_counter(4).value").as<int>());
+    }
+
+    void test_identity() {
+        using mrbind14::return_value_policy;
+        mrbind14::interpreter mruby;
+
+        Registry registry;
+        mruby.def_class<Counter>("Counter");
+        mruby.def_function("global_counter", [&registry]() -> Counter& { return registry.counter(); },
+                           return_value_policy::reference);
+        mruby.def_function("copied_counter", [&registry]() -> Counter& { return registry.counter(); });
+
+        CPPUNIT_ASSERT(mruby.execute("global_counter.equal?(global_counter)").as<bool>());
+        CPPUNIT_ASSERT(!mruby.execute("copied_counter.equal?(copied_counter)").as<bool>());
+    }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( class_test );
@@ -2,6 +2,7 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <string>
 #include <iostream>
+#include <sstream>
 
 using namespace std::string_literals;
 
@@ -33,6 +34,11 @@ bool f5_int_float(int x, float y) {
     return true;
 }
 
+struct Point {
+    Point(int x) : x(x) {}
+    int x;
+};
+
 class function_test : public CppUnit::TestFixture {
 
     CPPUNIT_TEST_SUITE( function_test );
@@ -43,6 +49,20 @@ class function_test : public CppUnit::TestFixture {
     CPPUNIT_TEST( test_def_std_function );
     CPPUNIT_TEST( test_def_lambda );
     CPPUNIT_TEST( test_def_function_object );
+    CPPUNIT_TEST( test_keyword_arguments );
+    CPPUNIT_TEST( test_default_arguments );
+    CPPUNIT_TEST( test_wrong_keyword_arguments );
+    CPPUNIT_TEST( test_signatures );
+    CPPUNIT_TEST( test_ranges );
+    CPPUNIT_TEST( test_generators );
+    CPPUNIT_TEST( test_blocks );
+    CPPUNIT_TEST( test_memoize );
+    CPPUNIT_TEST( test_vectorized );
+#if __cplusplus >= 201703L
+    CPPUNIT_TEST( test_string_view_argument );
+    CPPUNIT_TEST( test_optional );
+    CPPUNIT_TEST( test_variant );
+#endif
     //CPPUNIT_TEST( test_overload );
     CPPUNIT_TEST_SUITE_END();
 
@@ -166,6 +186,301 @@ class function_test : public CppUnit::TestFixture {
         CPPUNIT_ASSERT_NO_THROW(mruby.execute(code.c_str()));
     }
 
+    void test_keyword_arguments() {
+        using mrbind14::arg;
+        mrbind14::interpreter mruby;
+
+        mruby.def_function("sub", [](int x, int y) { return x - y; }, arg("x"), arg("y"));
+
+        CPPUNIT_ASSERT_EQUAL(1, mruby.execute("sub(3, 2)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(1, mruby.execute("sub(3, y: 2)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(1, mruby.execute("sub(y: 2, x: 3)").as<int>());
+    }
+
+    void test_default_arguments() {
+        using mrbind14::arg;
+        mrbind14::interpreter mruby;
+
+        mruby.def_function("greet",
+            [](const std::string& name, const std::string& greeting, int times) {
+                std::string result;
+                for(int i = 0; i < times; i++) result += greeting + " " + name + "!";
+                return result;
+            }, arg("name"), arg("greeting") = "Hello", arg("times") = 1);
+
+        CPPUNIT_ASSERT_EQUAL("Hello Matthieu!"s,
+            mruby.execute("greet('Matthieu')").as<std::string>());
+        CPPUNIT_ASSERT_EQUAL("Hi Matthieu!"s,
+            mruby.execute("greet('Matthieu', 'Hi')").as<std::string>());
+        CPPUNIT_ASSERT_EQUAL("Hello Matthieu!Hello Matthieu!"s,
+            mruby.execute("greet('Matthieu', times: 2)").as<std::string>());
+    }
+
+    void test_wrong_keyword_arguments() {
+        using mrbind14::arg;
+        mrbind14::interpreter mruby;
+
+        mruby.def_function("sub", [](int x, int y) { return x - y; }, arg("x"), arg("y") = 1);
+
+        // unknown keyword
+        CPPUNIT_ASSERT_THROW(mruby.execute("sub(3, z: 2)"), std::bad_function_call);
+        // missing argument without default
+        CPPUNIT_ASSERT_THROW(mruby.execute("sub(y: 2)"), std::bad_function_call);
+        // keyword given for a parameter already passed positionally
+        CPPUNIT_ASSERT_THROW(mruby.execute("sub(3, 2, x: 1)"), std::bad_function_call);
+    }
+
+    void test_signatures() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_function("f1", f1);
+        mruby.def_function("f4", f4);
+
+        std::ostringstream ss;
+        mruby.write_signatures(ss);
+        CPPUNIT_ASSERT_EQUAL("f1() -> void\nf4(int, float, string, bool) -> bool\n"s, ss.str());
+
+        // signatures follow the names registered after they were built
+        mrbind14::interpreter other;
+        other.def_function("get_x", [](const Point& p) { return p.x; });
+        std::ostringstream before;
+        other.write_signatures(before);
+        CPPUNIT_ASSERT_EQUAL("get_x(Point) -> int\n"s, before.str());
+        other.def_class<Point>("Vec2");
+        std::ostringstream after;
+        other.write_signatures(after);
+        CPPUNIT_ASSERT_EQUAL("get_x(Vec2) -> int\n"s, after.str());
+    }
+
+    void test_ranges() {
+        mrbind14::interpreter mruby;
+
+        std::vector<int> data(200);
+        for(int i = 0; i < 200; i++) data[i] = i;
+        mruby.def_function("numbers", [&data]() {
+            return mrbind14::make_range(data.begin(), data.end());
+        });
+        mruby.def_function("words", []() {
+            return mrbind14::make_range(std::vector<std::string>{ "a", "b", "c" });
+        });
+
+        CPPUNIT_ASSERT_EQUAL(200, mruby.execute("numbers.to_a.size").as<int>());
+        CPPUNIT_ASSERT_EQUAL(398, mruby.execute("numbers.map { |x| x * 2 }.last").as<int>());
+        CPPUNIT_ASSERT_EQUAL(199*200/2, mruby.execute("r = numbers; r.inject(:+)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(199*200/2, mruby.execute("r.inject(:+)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(10, mruby.execute("numbers.each { |x| break x if x == 10 }").as<int>());
+        CPPUNIT_ASSERT_EQUAL("abc"s, mruby.execute("words.to_a.join").as<std::string>());
+        CPPUNIT_ASSERT(mruby.execute(R"ruby(
+            sizes = []
+            numbers.each_batch(64) { |batch| sizes << batch.size }
+            sizes == [64, 64, 64, 8]
+        )ruby").as<bool>());
+        CPPUNIT_ASSERT_THROW(mruby.execute("CppRange.new"), std::runtime_error);
+    }
+
+    void test_generators() {
+        mrbind14::interpreter mruby;
+
+        int pulled = 0;
+        mruby.def_function("naturals", [&pulled]() {
+            return mrbind14::make_generator<int>([&pulled, i = 0](int& next) mutable {
+                pulled++;
+                next = i++;
+                return true;
+            });
+        });
+
+        CPPUNIT_ASSERT(mruby.execute(R"ruby(
+            $n = naturals
+            a = []
+            $n.each { |x| break if x >= 5; a << x }
+            a == [0, 1, 2, 3, 4]
+        )ruby").as<bool>());
+        CPPUNIT_ASSERT(pulled <= 64);
+        CPPUNIT_ASSERT_EQUAL(6, mruby.execute("$n.each { |x| break x }").as<int>());
+        CPPUNIT_ASSERT_EQUAL(7, mruby.execute("$n.each_batch(3) { |b| break b.first }").as<int>());
+        CPPUNIT_ASSERT_EQUAL(10, mruby.execute("$n.each { |x| break x }").as<int>());
+    }
+
+    void test_blocks() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_function("each_row", [](int n, mrbind14::block b) {
+            auto yield = b.invoker<int, const char*>();
+            for(int i = 0; i < n; i++) yield(i, "row");
+        });
+        mruby.def_function("count_if", [](int n, const mrbind14::block& pred) {
+            auto call = pred.invoker<int>();
+            int count = 0;
+            for(int i = 0; i < n; i++)
+                if(mrb_test(call(i))) count++;
+            return count;
+        });
+        mruby.def_function("block_given", [](mrbind14::block b) { return static_cast<bool>(b); });
+        mruby.def_function("apply", [](int x, mrbind14::block b) { return b(x, x); });
+
+        CPPUNIT_ASSERT_EQUAL(499500, mruby.execute("s = 0; each_row(1000) { |i, r| s += i }; s").as<int>());
+        CPPUNIT_ASSERT_EQUAL("row"s, mruby.execute("each_row(1) { |i, r| break r }").as<std::string>());
+        CPPUNIT_ASSERT_EQUAL(3, mruby.execute("each_row(10) { |i| break i if i == 3 }").as<int>());
+        CPPUNIT_ASSERT_EQUAL(50, mruby.execute("count_if(100) { |i| i.even? }").as<int>());
+        CPPUNIT_ASSERT_EQUAL(12, mruby.execute("apply(3) { |a, b| a * b + 3 }").as<int>());
+        CPPUNIT_ASSERT(mruby.execute("block_given { }").as<bool>());
+        CPPUNIT_ASSERT(!mruby.execute("block_given").as<bool>());
+        CPPUNIT_ASSERT_THROW(mruby.execute("each_row(3)"), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(mruby.execute("each_row(3, 4)"), std::bad_function_call);
+    }
+
+    void test_memoize() {
+        mrbind14::interpreter mruby;
+
+        int calls = 0;
+        mruby.def_function("slow_add", [&calls](int x, double y) {
+            calls++;
+            return x + y;
+        }, mrbind14::pure());
+        mruby.def_function("greet", [&calls](const std::string& name) {
+            calls++;
+            return "hello " + name;
+        }, mrbind14::memoize(2));
+        mruby.def_function("count", [&calls](const mrbind14::object& list) {
+            calls++;
+            return 0;
+        }, mrbind14::memoize(2));
+
+        CPPUNIT_ASSERT_EQUAL(3.5, mruby.execute("slow_add(1, 2.5)").as<double>());
+        CPPUNIT_ASSERT_EQUAL(3.5, mruby.execute("slow_add(1, 2.5)").as<double>());
+        CPPUNIT_ASSERT_EQUAL(1, calls);
+        CPPUNIT_ASSERT_EQUAL(4.0, mruby.execute("slow_add(1, 3.0)").as<double>());
+        CPPUNIT_ASSERT_EQUAL(2, calls);
+
+        // returned strings are copies, modifying them leaves the cache intact
+        CPPUNIT_ASSERT_EQUAL("hello a!"s, mruby.execute("greet('a') << '!'").as<std::string>());
+        CPPUNIT_ASSERT_EQUAL("hello a"s, mruby.execute("greet('a')").as<std::string>());
+        CPPUNIT_ASSERT_EQUAL(3, calls);
+        // the least recently used entry is evicted
+        mruby.execute("greet('b'); greet('a'); greet('c')");
+        CPPUNIT_ASSERT_EQUAL(5, calls);
+        mruby.execute("greet('a')");
+        CPPUNIT_ASSERT_EQUAL(5, calls);
+        mruby.execute("greet('b')");
+        CPPUNIT_ASSERT_EQUAL(6, calls);
+
+        // arrays are not cached
+        mruby.execute("count([1]); count([1])");
+        CPPUNIT_ASSERT_EQUAL(8, calls);
+
+        auto stats = mruby.memoize_stats();
+        CPPUNIT_ASSERT_EQUAL((size_t)3, stats.size());
+        CPPUNIT_ASSERT_EQUAL("slow_add"s, stats[0].name);
+        CPPUNIT_ASSERT_EQUAL((uint64_t)1, stats[0].hits);
+        CPPUNIT_ASSERT_EQUAL((uint64_t)2, stats[0].misses);
+        CPPUNIT_ASSERT_EQUAL("greet"s, stats[1].name);
+        CPPUNIT_ASSERT_EQUAL((uint64_t)3, stats[1].hits);
+        CPPUNIT_ASSERT_EQUAL((uint64_t)4, stats[1].misses);
+        CPPUNIT_ASSERT_EQUAL((uint64_t)2, stats[1].evictions);
+        CPPUNIT_ASSERT_EQUAL((size_t)2, stats[1].size);
+        CPPUNIT_ASSERT_EQUAL((uint64_t)2, stats[2].uncached);
+        CPPUNIT_ASSERT_EQUAL(0.0, stats[2].hit_rate());
+
+        mruby.clear_memoized();
+        mruby.execute("slow_add(1, 2.5)");
+        CPPUNIT_ASSERT_EQUAL(9, calls);
+        CPPUNIT_ASSERT_EQUAL((uint64_t)0, mruby.memoize_stats()[0].hits);
+
+        // a memoized function calling itself inserts the same keys again
+        mruby.def_function("fib", [&mruby](int n) {
+            if(n < 2) return n;
+            std::string code = "fib(" + std::to_string(n-1) + ") + fib(" + std::to_string(n-2) + ")";
+            return mruby.execute(code.c_str()).as<int>();
+        }, mrbind14::memoize(2));
+        CPPUNIT_ASSERT_EQUAL(55, mruby.execute("fib(10)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(55, mruby.execute("fib(10)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(610, mruby.execute("fib(15)").as<int>());
+
+        int depth = 0;
+        mruby.def_function("twice", [&mruby, &depth](int n) {
+            if(depth++ == 0) mruby.execute("twice(3)");
+            depth--;
+            return 2*n;
+        }, mrbind14::memoize(1));
+        CPPUNIT_ASSERT_EQUAL(6, mruby.execute("twice(3)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(8, mruby.execute("twice(4)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(6, mruby.execute("twice(3)").as<int>());
+        CPPUNIT_ASSERT_EQUAL((size_t)1, mruby.memoize_stats().back().size);
+    }
+
+    void test_vectorized() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_vectorized("score", [](double x, double y) { return x * y + 1; });
+        mruby.def_vectorized("label", [](const std::string& name, int i) {
+            return name + std::to_string(i);
+        });
+        mruby.def_vectorized("positive", [](int x) { return x > 0; });
+
+        CPPUNIT_ASSERT_EQUAL(7.0, mruby.execute("score(2.0, 3.0)").as<double>());
+        CPPUNIT_ASSERT(mruby.execute("score([1.0, 2.0, 3.0], [2.0, 2.0, 2.0]) == [3.0, 5.0, 7.0]").as<bool>());
+        // scalars are repeated for all the elements
+        CPPUNIT_ASSERT(mruby.execute("score([1.0, 2.0], 10.0) == [11.0, 21.0]").as<bool>());
+        CPPUNIT_ASSERT(mruby.execute("label('x', [1, 2]) == ['x1', 'x2']").as<bool>());
+        CPPUNIT_ASSERT(mruby.execute("positive([-1, 0, 3]) == [false, false, true]").as<bool>());
+        CPPUNIT_ASSERT(mruby.execute("score([], 1.0) == []").as<bool>());
+        CPPUNIT_ASSERT_EQUAL(100000.0, mruby.execute(
+            "score(Array.new(100000) { |i| i.to_f }, 0.0).inject(:+)").as<double>());
+
+        CPPUNIT_ASSERT_THROW(mruby.execute("score([1.0, 2.0], [1.0])"), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(mruby.execute("score([1.0, 'a'], 2.0)"), std::runtime_error);
+        CPPUNIT_ASSERT_THROW(mruby.execute("score([1.0], 'a')"), std::bad_function_call);
+    }
+
+#if __cplusplus >= 201703L
+    void test_string_view_argument() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_function("first_word", [](std::string_view str) {
+            return std::string(str.substr(0, str.find(' ')));
+        });
+
+        CPPUNIT_ASSERT_EQUAL("Hello"s, mruby.execute("first_word('Hello Matthieu')").as<std::string>());
+        CPPUNIT_ASSERT_EQUAL("Hello"s, mruby.execute("first_word(:Hello)").as<std::string>());
+    }
+
+    void test_optional() {
+        mrbind14::interpreter mruby;
+
+        mruby.def_function("increment", [](std::optional<int> x) -> std::optional<int> {
+            if(x) return *x + 1;
+            return std::nullopt;
+        });
+
+        CPPUNIT_ASSERT_EQUAL(3, mruby.execute("increment(2)").as<int>());
+        CPPUNIT_ASSERT(mruby.execute("increment(nil).nil?").as<bool>());
+        CPPUNIT_ASSERT_THROW(mruby.execute("increment('a')"), std::bad_function_call);
+    }
+
+    void test_variant() {
+        mrbind14::interpreter mruby;
+
+        using value = std::variant<int, double, std::string>;
+        mruby.def_function("kind", [](const value& v) { return (int)v.index(); });
+        mruby.def_function("same", [](const value& v) { return v; });
+
+        CPPUNIT_ASSERT_EQUAL(0, mruby.execute("kind(1)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(1, mruby.execute("kind(1.5)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(2, mruby.execute("kind('a')").as<int>());
+        CPPUNIT_ASSERT_EQUAL(2, mruby.execute("kind(:a)").as<int>());
+        CPPUNIT_ASSERT_EQUAL(1.5, mruby.execute("same(1.5)").as<double>());
+        CPPUNIT_ASSERT_EQUAL("abc"s, mruby.execute("same('abc')").as<std::string>());
+        CPPUNIT_ASSERT_THROW(mruby.execute("kind([])"), std::bad_function_call);
+
+        // a bound class wins over an earlier alternative accepting anything
+        mruby.def_class<Point>("Point").def_init<int>();
+        mruby.def_function("kind_of_point", [](const std::variant<bool, Point>& v) { return (int)v.index(); });
+        CPPUNIT_ASSERT_EQUAL(1, mruby.execute("kind_of_point(Point.new(1))").as<int>());
+        CPPUNIT_ASSERT_EQUAL(0, mruby.execute("kind_of_point(true)").as<int>());
+    }
+#endif
+
     void test_overload() {
         mrbind14::interpreter mruby;
 
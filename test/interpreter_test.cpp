@@ -2,6 +2,8 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <string>
 #include <iostream>
+#include <cstdlib>
+#include <unistd.h>
 
 using namespace std::string_literals;
 
@@ -11,9 +13,20 @@ class interpreter_test : public CppUnit::TestFixture {
 
   CPPUNIT_TEST_SUITE( interpreter_test );
   CPPUNIT_TEST( test_execute );
+  CPPUNIT_TEST( test_execute_sized );
+  CPPUNIT_TEST( test_execute_file );
+  CPPUNIT_TEST( test_independent_scripts );
+  CPPUNIT_TEST( test_session );
   CPPUNIT_TEST( test_def_const );
   CPPUNIT_TEST( test_undefined_const );
   CPPUNIT_TEST( test_def_global );
+  CPPUNIT_TEST( test_gc_stats );
+  CPPUNIT_TEST( test_gc_arena_scope );
+  CPPUNIT_TEST( test_gc_pause_scope );
+  CPPUNIT_TEST( test_gc_tuning );
+#ifdef MRB_ENABLE_DEBUG_HOOK
+  CPPUNIT_TEST( test_script_profiling );
+#endif
   CPPUNIT_TEST_SUITE_END();
 
   public:
@@ -33,6 +46,62 @@ class interpreter_test : public CppUnit::TestFixture {
     CPPUNIT_ASSERT_EQUAL(42, mruby.execute(code.c_str()).as<int>());
   }
 
+  void test_execute_sized() {
+    mrbind14::interpreter mruby;
+
+    // only the first 5 bytes are part of the script
+    const char buffer[] = { '4', '0', ' ', '+', '2', '+', '!' };
+    CPPUNIT_ASSERT_EQUAL(42, mruby.execute(buffer, 5).as<int>());
+    CPPUNIT_ASSERT_EQUAL(42, mruby.execute(buffer, 5, "buffer.rb").as<int>());
+    CPPUNIT_ASSERT_THROW(mruby.execute(buffer, 7), std::runtime_error);
+#if __cplusplus >= 201703L
+    CPPUNIT_ASSERT_EQUAL(40, mruby.execute(std::string_view(buffer, 2)).as<int>());
+#endif
+  }
+
+  void test_execute_file() {
+    mrbind14::interpreter mruby;
+
+    char path[] = "/tmp/mrbind14_test_XXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd >= 0);
+    std::string code = "x = 40\nx + 2\n";
+    CPPUNIT_ASSERT_EQUAL((ssize_t)code.size(), write(fd, code.data(), code.size()));
+    close(fd);
+
+    CPPUNIT_ASSERT_EQUAL(42, mruby.execute_file(path).as<int>());
+    CPPUNIT_ASSERT_EQUAL(42, mruby.execute_file(path).as<int>());
+    unlink(path);
+    CPPUNIT_ASSERT_THROW(mruby.execute_file(path), std::runtime_error);
+  }
+
+  void test_independent_scripts() {
+    mrbind14::interpreter mruby;
+
+    mruby.execute("x = 42");
+    CPPUNIT_ASSERT_THROW(mruby.execute("x"), std::runtime_error);
+  }
+
+  void test_session() {
+    mrbind14::interpreter mruby;
+    mrbind14::session repl(mruby);
+
+    repl.evaluate("x = 40");
+    repl.evaluate("y = 2");
+    mruby.execute("a = 1; b = 2; c = 3");
+    CPPUNIT_ASSERT_EQUAL(42, repl.evaluate("x + y").as<int>());
+    CPPUNIT_ASSERT_EQUAL(3u, (unsigned)repl.evaluations());
+    CPPUNIT_ASSERT_EQUAL(2u, (unsigned)repl.local_variables().size());
+
+    // errors do not end the session
+    CPPUNIT_ASSERT_THROW(repl.evaluate("x +"), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(repl.evaluate("undefined_method"), std::runtime_error);
+    CPPUNIT_ASSERT_EQUAL(40, repl.evaluate("x").as<int>());
+
+    repl.reset();
+    CPPUNIT_ASSERT_THROW(repl.evaluate("x"), std::runtime_error);
+  }
+
   void test_def_const() {
     mrbind14::interpreter mruby;
 
@@ -82,6 +151,108 @@ class interpreter_test : public CppUnit::TestFixture {
     CPPUNIT_ASSERT_THROW(mruby.execute(code.c_str()), std::runtime_error);
   }
 
+  void test_gc_stats() {
+    mrbind14::interpreter mruby;
+
+    mruby.execute("$objects = (1..1000).map { |i| i.to_s }");
+    auto stats = mruby.get_gc_stats();
+    CPPUNIT_ASSERT(stats.live_objects >= 1000);
+    CPPUNIT_ASSERT(stats.heap_pages > 0);
+    CPPUNIT_ASSERT_EQUAL((uint64_t)0, stats.collections);
+
+    mruby.execute("$objects = nil");
+    mruby.full_gc();
+    auto after = mruby.get_gc_stats();
+    CPPUNIT_ASSERT_EQUAL((uint64_t)1, after.collections);
+    CPPUNIT_ASSERT(after.live_objects < stats.live_objects);
+  }
+
+  void test_gc_arena_scope() {
+    mrbind14::interpreter mruby;
+
+    auto before = mruby.get_gc_stats().arena_index;
+    {
+      mrbind14::gc_arena_scope arena(mruby.mrb());
+      for(int i = 0; i < 100; i++)
+        mrbind14::object(mruby, std::to_string(i));
+      CPPUNIT_ASSERT(mruby.get_gc_stats().arena_index >= before + 100);
+    }
+    CPPUNIT_ASSERT_EQUAL(before, mruby.get_gc_stats().arena_index);
+
+    mruby.def_function("make_string", [](int i) { return std::to_string(i); });
+    mruby.execute("10000.times { |i| make_string(i) }");
+    CPPUNIT_ASSERT(mruby.get_gc_stats().arena_index <= before + 1);
+  }
+
+  void test_gc_pause_scope() {
+    mrbind14::interpreter mruby;
+
+    auto live = mruby.get_gc_stats().live_objects;
+    {
+      mrbind14::gc_pause_scope pause(mruby.mrb());
+      mruby.execute("(1..10000).each { |i| i.to_s }");
+      CPPUNIT_ASSERT(mruby.get_gc_stats().live_objects >= live + 10000);
+    }
+    CPPUNIT_ASSERT(!mruby.mrb()->gc.disabled);
+  }
+
+  void test_gc_tuning() {
+    mrbind14::interpreter mruby;
+
+    mruby.set_gc_mode(mrbind14::gc_mode::generational);
+    CPPUNIT_ASSERT(mrbind14::gc_mode::generational == mruby.get_gc_mode());
+    mruby.set_gc_mode(mrbind14::gc_mode::incremental);
+    CPPUNIT_ASSERT(mrbind14::gc_mode::incremental == mruby.get_gc_mode());
+
+    mruby.set_gc_step_ratio(400);
+    mruby.set_gc_interval_ratio(150);
+    CPPUNIT_ASSERT_EQUAL(400, mruby.get_gc_step_ratio());
+    CPPUNIT_ASSERT_EQUAL(150, mruby.get_gc_interval_ratio());
+
+    mruby.execute("(1..10000).each { |i| i.to_s }");
+    CPPUNIT_ASSERT(mruby.incremental_step(std::chrono::seconds(10)));
+    CPPUNIT_ASSERT(mruby.gc_between_requests(std::chrono::seconds(10)));
+    mruby.full_gc();
+
+    auto pauses = mruby.get_gc_pause_stats();
+    CPPUNIT_ASSERT(pauses.count >= 2);
+    CPPUNIT_ASSERT(pauses.p50_ns <= pauses.p99_ns);
+    CPPUNIT_ASSERT(pauses.p99_ns <= pauses.max_ns);
+    CPPUNIT_ASSERT(pauses.max_ns <= pauses.total_ns);
+
+    mruby.reset_gc_pause_stats();
+    CPPUNIT_ASSERT_EQUAL((uint64_t)0, mruby.get_gc_pause_stats().count);
+  }
+
+#ifdef MRB_ENABLE_DEBUG_HOOK
+  void test_script_profiling() {
+    mrbind14::interpreter mruby;
+
+    std::string code = R"ruby(
+      def busy(n)
+        s = 0
+        n.times { |i| s += i }
+        s
+      end
+      busy(10000)
+    )ruby";
+
+    mruby.start_script_profiling(100);
+    mruby.execute(code.c_str());
+    mruby.stop_script_profiling();
+
+    const auto& stacks = mruby.script_profile();
+    CPPUNIT_ASSERT(!stacks.empty());
+    bool found = false;
+    for(const auto& s : stacks)
+      if(s.first.find("busy") != std::string::npos) found = true;
+    CPPUNIT_ASSERT(found);
+
+    mruby.reset_script_profile();
+    CPPUNIT_ASSERT(mruby.script_profile().empty());
+  }
+#endif
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION( interpreter_test );
@@ -0,0 +1,97 @@
+#include <mrbind14/mrbind14.hpp>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+using namespace std::string_literals;
+
+class json_test : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE( json_test );
+  CPPUNIT_TEST( test_parse );
+  CPPUNIT_TEST( test_parse_strings );
+  CPPUNIT_TEST( test_parse_errors );
+  CPPUNIT_TEST( test_generate );
+  CPPUNIT_TEST( test_round_trip );
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+
+  void setUp() {}
+  void tearDown() {}
+
+  void test_parse() {
+    mrbind14::interpreter mruby;
+    mruby.def_json_module();
+
+    CPPUNIT_ASSERT(mruby.execute(R"ruby(
+      JSON.parse('{"a": [1, -2, 3.5, 1e3, true, false, null], "b": {}, "c": []}') ==
+        { "a" => [1, -2, 3.5, 1000.0, true, false, nil], "b" => {}, "c" => [] }
+    )ruby").as<bool>());
+    CPPUNIT_ASSERT_EQUAL(42, mruby.execute("JSON.parse(' 42 ')").as<int>());
+    CPPUNIT_ASSERT(mruby.execute("JSON.parse('12345678901234567890').is_a?(Float)").as<bool>());
+    // the bounds of mrb_int are parsed exactly
+    std::string max = std::to_string(MRB_INT_MAX), min = std::to_string(MRB_INT_MIN);
+    CPPUNIT_ASSERT_EQUAL((int64_t)MRB_INT_MAX, mruby.execute(("JSON.parse('" + max + "')").c_str()).as<int64_t>());
+    CPPUNIT_ASSERT_EQUAL((int64_t)MRB_INT_MIN, mruby.execute(("JSON.parse('" + min + "')").c_str()).as<int64_t>());
+    CPPUNIT_ASSERT(mruby.execute(("JSON.parse('" + max + "0').is_a?(Float)").c_str()).as<bool>());
+  }
+
+  void test_parse_strings() {
+    mrbind14::interpreter mruby;
+    mruby.def_json_module();
+
+    CPPUNIT_ASSERT_EQUAL("a long string without any escape"s,
+        mruby.execute(R"ruby(JSON.parse('"a long string without any escape"'))ruby").as<std::string>());
+    CPPUNIT_ASSERT_EQUAL("tab\there \"quoted\" \\ /"s,
+        mruby.execute(R"ruby(JSON.parse('"tab\\there \\"quoted\\" \\\\ \\/"'))ruby").as<std::string>());
+    CPPUNIT_ASSERT_EQUAL("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"s,
+        mruby.execute(R"ruby(JSON.parse('"\\u00e9\\u20AC\\ud83d\\ude00"'))ruby").as<std::string>());
+  }
+
+  void test_parse_errors() {
+    mrbind14::interpreter mruby;
+    mruby.def_json_module();
+
+    const char* invalid[] = {
+      "JSON.parse('')", "JSON.parse('[1, 2')", "JSON.parse('[1 2]')", "JSON.parse('{1: 2}')",
+      "JSON.parse('\"abc')", "JSON.parse('01')", "JSON.parse('-')", "JSON.parse('tru')",
+      "JSON.parse('\"\\\\x\"')", "JSON.parse('\"\\\\ud83d\"')", "JSON.parse('[1] 2')",
+      "JSON.parse('[' * 101 + ']' * 101)"
+    };
+    for(auto code : invalid)
+      CPPUNIT_ASSERT_THROW(mruby.execute(code), std::runtime_error);
+    CPPUNIT_ASSERT(mruby.execute(R"ruby(
+      begin
+        JSON.parse('[1,]')
+        false
+      rescue JSON::ParserError => e
+        e.is_a?(JSON::JSONError)
+      end
+    )ruby").as<bool>());
+    CPPUNIT_ASSERT_NO_THROW(mruby.execute("JSON.parse('[' * 100 + ']' * 100)"));
+  }
+
+  void test_generate() {
+    mrbind14::interpreter mruby;
+    mruby.def_json_module();
+
+    CPPUNIT_ASSERT_EQUAL(R"({"a":[1,-20,0.1,3.0,true,false,null],"b":"x\"y\\z\n\u0001","c":"sym"})"s,
+        mruby.execute(R"ruby(
+          JSON.generate({ "a" => [1, -20, 0.1, 3.0, true, false, nil], :b => "x\"y\\z\n\x01", "c" => :sym })
+        )ruby").as<std::string>());
+    CPPUNIT_ASSERT_EQUAL(R"({"1":"1..2"})"s, mruby.execute("JSON.dump({ 1 => (1..2) })").as<std::string>());
+    CPPUNIT_ASSERT_THROW(mruby.execute("JSON.generate([1.0 / 0])"), std::runtime_error);
+  }
+
+  void test_round_trip() {
+    mrbind14::interpreter mruby;
+    mruby.def_json_module("Json");
+
+    CPPUNIT_ASSERT(mruby.execute(R"ruby(
+      value = (0...1000).map { |i| { "id" => i, "name" => "item #{i}", "score" => i / 3.0, "tags" => ["a", "b\n"] } }
+      Json.parse(Json.generate(value)) == value
+    )ruby").as<bool>());
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( json_test );
@@ -2,9 +2,17 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <string>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
 
 using namespace std::string_literals;
 
+enum class Color { red, green, blue };
+
+enum Permission { perm_read = 1, perm_write = 2, perm_execute = 4 };
+
 
 
 class module_test : public CppUnit::TestFixture {
@@ -13,6 +21,12 @@ class module_test : public CppUnit::TestFixture {
   CPPUNIT_TEST( test_def_module );
   CPPUNIT_TEST( test_def_const );
   CPPUNIT_TEST( test_undefined_const );
+  CPPUNIT_TEST( test_def_lazy_module );
+  CPPUNIT_TEST( test_nested_lazy_module );
+  CPPUNIT_TEST( test_def_enum );
+  CPPUNIT_TEST( test_def_flags );
+  CPPUNIT_TEST( test_def_shared_table );
+  CPPUNIT_TEST( test_shared_table_kinds );
   CPPUNIT_TEST_SUITE_END();
 
   public:
@@ -65,6 +79,104 @@ class module_test : public CppUnit::TestFixture {
     CPPUNIT_ASSERT_THROW(mruby.execute(code.c_str()), std::runtime_error);
   }
 
+  void test_def_lazy_module() {
+    mrbind14::interpreter mruby;
+
+    int initialized = 0;
+    mruby.def_lazy_module("Lazy", [&initialized](mrbind14::module& mod) {
+        initialized += 1;
+        mod.def_const("VALUE", 42);
+        mod.def_function("twice", [](int x) { return 2*x; });
+    });
+
+    CPPUNIT_ASSERT_EQUAL(0, initialized);
+    CPPUNIT_ASSERT_EQUAL(42, mruby.execute("Lazy::VALUE").as<int>());
+    CPPUNIT_ASSERT_EQUAL(1, initialized);
+    CPPUNIT_ASSERT_EQUAL(8, mruby.execute("Lazy.twice(4)").as<int>());
+    CPPUNIT_ASSERT_EQUAL(1, initialized);
+    CPPUNIT_ASSERT_THROW(mruby.execute("Undefined"), std::runtime_error);
+  }
+
+  void test_nested_lazy_module() {
+    mrbind14::interpreter mruby;
+
+    auto mod = mruby.def_module("MyModule");
+    mod.def_lazy_module("Outer", [](mrbind14::module& outer) {
+        outer.def_lazy_module("Inner", [](mrbind14::module& inner) {
+            inner.def_const("NAME", "inner"s);
+        });
+    });
+
+    CPPUNIT_ASSERT_EQUAL("inner"s, mruby.execute("MyModule::Outer::Inner::NAME").as<std::string>());
+    CPPUNIT_ASSERT_THROW(mruby.execute("MyModule::Outer::Other"), std::runtime_error);
+  }
+
+  void test_def_enum() {
+    mrbind14::interpreter mruby;
+
+    mruby.def_enum<Color>("Color",
+        {{"red", Color::red}, {"green", Color::green}, {"blue", Color::blue}});
+    mruby.def_function("next_color", [](Color c) {
+        return static_cast<Color>((static_cast<int>(c) + 1) % 3);
+    });
+
+    CPPUNIT_ASSERT(mruby.execute("Color::RED == :red").as<bool>());
+    CPPUNIT_ASSERT(mruby.execute("next_color(:red) == :green").as<bool>());
+    CPPUNIT_ASSERT(mruby.execute("next_color(Color::BLUE) == :red").as<bool>());
+    CPPUNIT_ASSERT(Color::green == mruby.execute("next_color(0)").as<Color>());
+    CPPUNIT_ASSERT_THROW(mruby.execute("next_color(:yellow)"), std::bad_function_call);
+    CPPUNIT_ASSERT_THROW(mruby.execute("next_color(3)"), std::bad_function_call);
+  }
+
+  void test_def_flags() {
+    mrbind14::interpreter mruby;
+
+    mruby.def_enum<Permission>("Permission",
+        {{"read", perm_read}, {"write", perm_write}, {"execute", perm_execute}}, true);
+    mruby.def_function("can_write", [](Permission p) { return (p & perm_write) != 0; });
+
+    CPPUNIT_ASSERT(mruby.execute("can_write(Permission::READ | Permission::WRITE)").as<bool>());
+    CPPUNIT_ASSERT(mruby.execute("can_write([:read, :write])").as<bool>());
+    CPPUNIT_ASSERT(!mruby.execute("can_write(:read)").as<bool>());
+    CPPUNIT_ASSERT_THROW(mruby.execute("can_write(8)"), std::bad_function_call);
+  }
+
+  void test_def_shared_table() {
+    auto table = std::make_shared<const std::map<std::string, int>>(
+        std::map<std::string, int>{{"one", 1}, {"two", 2}, {"three", 3}});
+    mrbind14::interpreter mruby1;
+    mrbind14::interpreter mruby2;
+    mruby1.def_shared_table("NUMBERS", table);
+    mruby2.def_module("Data").def_shared_table("NUMBERS", table);
+    CPPUNIT_ASSERT_EQUAL(3L, table.use_count());
+
+    CPPUNIT_ASSERT_EQUAL(2, mruby1.execute("NUMBERS['two']").as<int>());
+    CPPUNIT_ASSERT_EQUAL(3, mruby2.execute("Data::NUMBERS.fetch('three')").as<int>());
+    CPPUNIT_ASSERT(mruby1.execute("NUMBERS['four'].nil?").as<bool>());
+    CPPUNIT_ASSERT(mruby1.execute("NUMBERS[4].nil?").as<bool>());
+    CPPUNIT_ASSERT_EQUAL(0, mruby1.execute("NUMBERS.fetch('four', 0)").as<int>());
+    CPPUNIT_ASSERT_THROW(mruby1.execute("NUMBERS.fetch('four')"), std::runtime_error);
+    CPPUNIT_ASSERT(mruby1.execute("NUMBERS.key?('one') && !NUMBERS.key?('zero')").as<bool>());
+    CPPUNIT_ASSERT_EQUAL(3, mruby1.execute("NUMBERS.size").as<int>());
+    CPPUNIT_ASSERT_EQUAL(6, mruby1.execute("NUMBERS.inject(0) { |s, (k, v)| s + v }").as<int>());
+    CPPUNIT_ASSERT(mruby1.execute("NUMBERS.frozen?").as<bool>());
+    CPPUNIT_ASSERT_THROW(mruby1.execute("SharedTable.new"), std::runtime_error);
+  }
+
+  void test_shared_table_kinds() {
+    mrbind14::interpreter mruby;
+    mruby.def_shared_table("SORTED", std::make_shared<std::vector<std::pair<int, std::string>>>(
+        std::vector<std::pair<int, std::string>>{{2, "two"}, {3, "three"}, {5, "five"}}));
+    mruby.def_shared_table("SQUARES", std::make_shared<std::vector<double>>(
+        std::vector<double>{0.0, 1.0, 4.0}));
+
+    CPPUNIT_ASSERT_EQUAL("five"s, mruby.execute("SORTED[5]").as<std::string>());
+    CPPUNIT_ASSERT(mruby.execute("SORTED[4].nil?").as<bool>());
+    CPPUNIT_ASSERT(mruby.execute("SORTED['two'].nil?").as<bool>());
+    CPPUNIT_ASSERT_EQUAL(4.0, mruby.execute("SQUARES[2]").as<double>());
+    CPPUNIT_ASSERT(mruby.execute("SQUARES[-1].nil? && SQUARES[3].nil?").as<bool>());
+  }
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION( module_test );
@@ -0,0 +1,84 @@
+#include <mrbind14/mrbind14.hpp>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+using namespace std::string_literals;
+
+class msgpack_test : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE( msgpack_test );
+  CPPUNIT_TEST( test_scalars );
+  CPPUNIT_TEST( test_round_trip );
+  CPPUNIT_TEST( test_copy_value );
+  CPPUNIT_TEST( test_invalid_data );
+  CPPUNIT_TEST( test_unsupported_value );
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+
+  void setUp() {}
+  void tearDown() {}
+
+  void test_scalars() {
+    mrbind14::interpreter mruby;
+
+    CPPUNIT_ASSERT_EQUAL("\xc0"s, mrbind14::serialize(mruby.execute("nil")));
+    CPPUNIT_ASSERT_EQUAL("\xc3"s, mrbind14::serialize(mruby.execute("true")));
+    CPPUNIT_ASSERT_EQUAL("\x7f"s, mrbind14::serialize(mruby.execute("127")));
+    CPPUNIT_ASSERT_EQUAL("\xcc\x80"s, mrbind14::serialize(mruby.execute("128")));
+    CPPUNIT_ASSERT_EQUAL("\xff"s, mrbind14::serialize(mruby.execute("-1")));
+    CPPUNIT_ASSERT_EQUAL("\xd1\xfc\x18"s, mrbind14::serialize(mruby.execute("-1000")));
+    CPPUNIT_ASSERT_EQUAL("\xa3" "abc"s, mrbind14::serialize(mruby.execute("'abc'")));
+    CPPUNIT_ASSERT_EQUAL("\x92\x01\xc2"s, mrbind14::serialize(mruby.execute("[1, false]")));
+    CPPUNIT_ASSERT_EQUAL("\xd4\x00" "a"s, mrbind14::serialize(mruby.execute(":a")));
+  }
+
+  void test_round_trip() {
+    mrbind14::interpreter source;
+    mrbind14::interpreter target;
+
+    std::string buffer;
+    mrbind14::serialize(source.execute(R"ruby(
+      { "name" => "x" * 300, :ids => (1..1000).to_a, "nested" => [[1.5, nil], { -70000 => :sym }],
+        "big" => 2**40 }
+    )ruby"), buffer);
+    auto value = mrbind14::deserialize(target, buffer);
+    target.set_global("$value", value);
+
+    CPPUNIT_ASSERT_EQUAL(300, target.execute("$value['name'].size").as<int>());
+    CPPUNIT_ASSERT_EQUAL(500500, target.execute("$value[:ids].inject(:+)").as<int>());
+    CPPUNIT_ASSERT(target.execute("$value['nested'] == [[1.5, nil], { -70000 => :sym }]").as<bool>());
+    CPPUNIT_ASSERT(target.execute("$value['big'] == 2**40").as<bool>());
+
+    // serializing again gives the same bytes
+    CPPUNIT_ASSERT(buffer == mrbind14::serialize(target.execute("$value")));
+  }
+
+  void test_copy_value() {
+    mrbind14::interpreter source;
+    mrbind14::interpreter target;
+
+    auto value = mrbind14::copy_value(source.execute("{ a: [1, 'two', 3.0], 'b' => nil }"), target);
+    target.set_global("$value", value);
+    CPPUNIT_ASSERT(target.execute("$value == { a: [1, 'two', 3.0], 'b' => nil }").as<bool>());
+  }
+
+  void test_invalid_data() {
+    mrbind14::interpreter mruby;
+
+    // truncated string, truncated array, unused tag, trailing bytes
+    CPPUNIT_ASSERT_THROW(mrbind14::deserialize(mruby, "\xa3" "ab"s), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(mrbind14::deserialize(mruby, "\xdd\xff\xff\xff\xff"s), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(mrbind14::deserialize(mruby, "\xc1"s), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(mrbind14::deserialize(mruby, "\xc0\xc0"s), std::runtime_error);
+  }
+
+  void test_unsupported_value() {
+    mrbind14::interpreter mruby;
+
+    CPPUNIT_ASSERT_THROW(mrbind14::serialize(mruby.execute("Object.new")), std::runtime_error);
+    CPPUNIT_ASSERT_THROW(mrbind14::serialize(mruby.execute("a = []; a << a; a")), std::runtime_error);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( msgpack_test );
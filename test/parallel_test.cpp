@@ -0,0 +1,88 @@
+#include <mrbind14/mrbind14.hpp>
+#include <cppunit/extensions/HelperMacros.h>
+#include <numeric>
+#include <string>
+#include <vector>
+
+class parallel_test : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE( parallel_test );
+  CPPUNIT_TEST( test_parallel_for_each );
+  CPPUNIT_TEST( test_small_input );
+  CPPUNIT_TEST( test_script_error );
+  CPPUNIT_TEST( test_wrong_result_type );
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+
+  void setUp() {}
+  void tearDown() {}
+
+  static void setup(mrbind14::interpreter& mruby) {
+    mruby.def_function("scale", [](int x) { return 3*x; });
+  }
+
+  void test_parallel_for_each() {
+    mrbind14::interpreter_pool pool(setup, 4);
+    CPPUNIT_ASSERT_EQUAL((size_t)4, pool.size());
+
+    std::vector<int> records(100000);
+    std::iota(records.begin(), records.end(), 0);
+    std::vector<int> results;
+
+    auto stats = pool.parallel_for_each(records, "->(r) { scale(r) + 1 }", results, 64);
+
+    CPPUNIT_ASSERT_EQUAL(records.size(), results.size());
+    for(size_t i = 0; i < records.size(); i++)
+      CPPUNIT_ASSERT_EQUAL(3*records[i] + 1, results[i]);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)4, stats.size());
+    uint64_t total = 0;
+    for(const auto& s : stats) {
+      total += s.records;
+      CPPUNIT_ASSERT(s.chunks >= s.steals);
+    }
+    CPPUNIT_ASSERT_EQUAL((uint64_t)records.size(), total);
+  }
+
+  void test_small_input() {
+    mrbind14::interpreter_pool pool(setup, 4);
+
+    std::vector<double> records = { 1.5, 2.5 };
+    std::vector<std::string> results;
+    pool.parallel_for_each(records, "->(r) { (r * 2).to_s }", results);
+
+    CPPUNIT_ASSERT_EQUAL(std::string("3.0"), results[0]);
+    CPPUNIT_ASSERT_EQUAL(std::string("5.0"), results[1]);
+
+    std::vector<int> none;
+    std::vector<int> empty;
+    auto stats = pool.parallel_for_each(none, "->(r) { r }", empty);
+    CPPUNIT_ASSERT(empty.empty());
+    CPPUNIT_ASSERT_EQUAL((uint64_t)0, stats[0].records);
+  }
+
+  void test_script_error() {
+    mrbind14::interpreter_pool pool(setup, 2);
+
+    std::vector<int> records(1000, 1);
+    std::vector<int> results;
+    CPPUNIT_ASSERT_THROW(
+        pool.parallel_for_each(records, "->(r) { raise 'bad record' }", results),
+        std::runtime_error);
+    // the pool remains usable
+    CPPUNIT_ASSERT_NO_THROW(pool.parallel_for_each(records, "->(r) { scale(r) }", results));
+    CPPUNIT_ASSERT_EQUAL(3, results[999]);
+  }
+
+  void test_wrong_result_type() {
+    mrbind14::interpreter_pool pool(setup, 2);
+
+    std::vector<int> records(10, 1);
+    std::vector<std::string> results;
+    CPPUNIT_ASSERT_THROW(pool.parallel_for_each(records, "->(r) { r }", results),
+                         std::runtime_error);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( parallel_test );
@@ -0,0 +1,87 @@
+#define MRBIND14_ENABLE_PROFILING 1
+#include <mrbind14/mrbind14.hpp>
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+class profiler_test : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE( profiler_test );
+  CPPUNIT_TEST( test_function_profiles );
+  CPPUNIT_TEST( test_reset_profiles );
+  CPPUNIT_TEST( test_vectorized_profile );
+  CPPUNIT_TEST( test_export );
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+
+  void setUp() {}
+  void tearDown() {}
+
+  void test_function_profiles() {
+    mrbind14::interpreter mruby;
+
+    mruby.def_function("add", [](int x, int y) { return x + y; });
+    mruby.def_function("noop", []() {});
+
+    std::string code = R"ruby(
+      10.times { |i| add(i, 1) }
+      noop()
+    )ruby";
+
+    CPPUNIT_ASSERT_NO_THROW(mruby.execute(code.c_str()));
+
+    auto profiles = mruby.function_profiles();
+    CPPUNIT_ASSERT_EQUAL((size_t)2, profiles.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("add"), profiles[0].name);
+    CPPUNIT_ASSERT_EQUAL((uint64_t)10, profiles[0].calls);
+    CPPUNIT_ASSERT(profiles[0].max_ns <= profiles[0].total_ns);
+    CPPUNIT_ASSERT(profiles[0].conversion_ns <= profiles[0].total_ns);
+    CPPUNIT_ASSERT_EQUAL((uint64_t)1, profiles[1].calls);
+  }
+
+  void test_reset_profiles() {
+    mrbind14::interpreter mruby;
+
+    mruby.def_function("noop", []() {});
+    mruby.execute("noop()");
+    mruby.reset_function_profiles();
+
+    auto profiles = mruby.function_profiles();
+    CPPUNIT_ASSERT_EQUAL((uint64_t)0, profiles[0].calls);
+    CPPUNIT_ASSERT_EQUAL((uint64_t)0, profiles[0].total_ns);
+  }
+
+  void test_vectorized_profile() {
+    mrbind14::interpreter mruby;
+
+    mruby.def_vectorized("score", [](double x, double y) { return x * y + 1; });
+    mruby.execute("score(1.0, 2.0); score([1.0, 2.0], 2.0)");
+
+    auto profiles = mruby.function_profiles();
+    CPPUNIT_ASSERT_EQUAL((uint64_t)2, profiles[0].calls);
+    CPPUNIT_ASSERT(profiles[0].conversion_ns <= profiles[0].total_ns);
+
+    mruby.reset_function_profiles();
+    CPPUNIT_ASSERT_EQUAL((uint64_t)0, mruby.function_profiles()[0].calls);
+  }
+
+  void test_export() {
+    mrbind14::interpreter mruby;
+
+    mruby.def_function("noop", []() {});
+    mruby.execute("noop()");
+
+    std::stringstream json;
+    mruby.write_profile_json(json);
+    CPPUNIT_ASSERT(json.str().find("\"name\":\"noop\",\"calls\":1") != std::string::npos);
+
+    std::stringstream table;
+    mruby.write_profile_table(table);
+    CPPUNIT_ASSERT(table.str().find("noop") != std::string::npos);
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( profiler_test );
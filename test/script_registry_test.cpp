@@ -0,0 +1,142 @@
+#include <mrbind14/mrbind14.hpp>
+#include <cppunit/extensions/HelperMacros.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+class script_registry_test : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE( script_registry_test );
+  CPPUNIT_TEST( test_execute );
+  CPPUNIT_TEST( test_reload );
+  CPPUNIT_TEST( test_reload_polling );
+  CPPUNIT_TEST( test_compile_error );
+  CPPUNIT_TEST( test_in_flight );
+  CPPUNIT_TEST_SUITE_END();
+
+  std::string m_path;
+
+  public:
+
+  void setUp() {
+    m_path = "script_registry_test_" + std::to_string(::getpid()) + ".rb";
+  }
+
+  void tearDown() {
+    std::remove(m_path.c_str());
+  }
+
+  void write(const std::string& code) {
+    std::ofstream file(m_path, std::ios::trunc);
+    file << code;
+  }
+
+  /// Updates the registry until the script reaches the version
+  static bool wait_for_version(mrbind14::script_registry& scripts, uint64_t version) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(std::chrono::steady_clock::now() < deadline) {
+      scripts.update();
+      if(scripts.version("rules") >= version) return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+  }
+
+  void test_execute() {
+    mrbind14::interpreter mruby;
+    mruby.def_function("twice", [](int x) { return 2*x; });
+    mrbind14::script_registry scripts(mruby);
+
+    write("twice(21)");
+    scripts.add("rules", m_path);
+    CPPUNIT_ASSERT(scripts.contains("rules"));
+    CPPUNIT_ASSERT_EQUAL((uint64_t)1, scripts.version("rules"));
+    CPPUNIT_ASSERT_EQUAL(42, scripts.execute("rules").as<int>());
+    CPPUNIT_ASSERT_EQUAL(42, scripts.execute("rules").as<int>());
+    CPPUNIT_ASSERT_THROW(scripts.execute("other"), std::out_of_range);
+
+    write("raise 'invalid rule'");
+    scripts.add("rules", m_path);
+    CPPUNIT_ASSERT_THROW(scripts.execute("rules"), std::runtime_error);
+    CPPUNIT_ASSERT_EQUAL(3, mruby.execute("1 + 2").as<int>());
+
+    scripts.remove("rules");
+    CPPUNIT_ASSERT(!scripts.contains("rules"));
+  }
+
+  void test_reload() {
+    mrbind14::interpreter mruby;
+    mrbind14::script_registry scripts(mruby, std::chrono::milliseconds(10));
+
+    write("$state = ($state || 0) + 1; 'first'");
+    scripts.add("rules", m_path);
+    CPPUNIT_ASSERT_EQUAL(std::string("first"), scripts.execute("rules").as<std::string>());
+
+    write("$state = ($state || 0) + 10; 'second version'");
+    CPPUNIT_ASSERT(wait_for_version(scripts, 2));
+    CPPUNIT_ASSERT_EQUAL(std::string("second version"), scripts.execute("rules").as<std::string>());
+    // the state of the interpreter is kept across reloads
+    CPPUNIT_ASSERT_EQUAL(11, mruby.get_global<int>("$state"));
+
+    const auto& stats = scripts.stats("rules");
+    CPPUNIT_ASSERT_EQUAL((uint64_t)1, stats.reloads);
+    CPPUNIT_ASSERT_EQUAL((uint64_t)0, stats.failures);
+    CPPUNIT_ASSERT(stats.last_latency_ns <= stats.max_latency_ns);
+    CPPUNIT_ASSERT(stats.last_compile_ns > 0);
+  }
+
+  void test_reload_polling() {
+    mrbind14::interpreter mruby;
+    mrbind14::script_registry scripts(mruby, std::chrono::milliseconds(10), mrbind14::watch_mode::polling);
+    CPPUNIT_ASSERT(!scripts.uses_inotify());
+
+    write("1");
+    scripts.add("rules", m_path);
+    write("1 + 1");
+    CPPUNIT_ASSERT(wait_for_version(scripts, 2));
+    CPPUNIT_ASSERT_EQUAL(2, scripts.execute("rules").as<int>());
+  }
+
+  void test_compile_error() {
+    mrbind14::interpreter mruby;
+    mrbind14::script_registry scripts(mruby, std::chrono::milliseconds(10));
+
+    write("def broken(");
+    CPPUNIT_ASSERT_THROW(scripts.add("rules", m_path), std::runtime_error);
+    CPPUNIT_ASSERT(!scripts.contains("rules"));
+
+    write("40 + 2");
+    scripts.add("rules", m_path);
+    write("40 +* 2 end");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(scripts.stats("rules").failures == 0 && std::chrono::steady_clock::now() < deadline) {
+      scripts.update();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    CPPUNIT_ASSERT_EQUAL((uint64_t)1, scripts.stats("rules").failures);
+    CPPUNIT_ASSERT(scripts.last_error("rules").find(m_path + ":1:") == 0);
+    // the previous version stays in place
+    CPPUNIT_ASSERT_EQUAL((uint64_t)1, scripts.version("rules"));
+    CPPUNIT_ASSERT_EQUAL(42, scripts.execute("rules").as<int>());
+  }
+
+  void test_in_flight() {
+    mrbind14::interpreter mruby;
+    mrbind14::script_registry scripts(mruby, std::chrono::milliseconds(10));
+
+    // the script swaps itself while it is being executed
+    mruby.def_function("edit", [this, &scripts]() {
+      write("'new'");
+      return wait_for_version(scripts, 2);
+    });
+    write("edit ? 'old' : 'timeout'");
+    scripts.add("rules", m_path);
+    CPPUNIT_ASSERT_EQUAL(std::string("old"), scripts.execute("rules").as<std::string>());
+    CPPUNIT_ASSERT_EQUAL(std::string("new"), scripts.execute("rules").as<std::string>());
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( script_registry_test );